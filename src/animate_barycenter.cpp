@@ -62,7 +62,12 @@ int main(int argc, char** argv) {
         ("g,generalized", "Animate drawing the Generalized Petersen graph GP(n, k)",
             cxxopts::value<std::string>()->default_value(""))
         ("w,width", "Specify the width of the drawing", cxxopts::value<int>()->default_value("500"))
-        ("s,static", "Draw a still image of the graph (uses linear solver)", cxxopts::value<bool>()->default_value("false"));
+        ("s,static", "Draw a still image of the graph (uses linear solver)", cxxopts::value<bool>()->default_value("false"))
+        ("method", "Iterative solver to animate: jacobi, sor or multigrid", cxxopts::value<std::string>()->default_value("jacobi"))
+        ("omega", "Over-relaxation factor for --method sor", cxxopts::value<double>()->default_value("1.8"))
+        ("tolerance", "Stop once the residual has fallen by this factor", cxxopts::value<double>()->default_value("1e-4"))
+        ("threads", "Number of threads for the animated solver (0 = OMP_NUM_THREADS, or one per core)", cxxopts::value<int>()->default_value("0"))
+        ("save", "Also save the final positions as a layout snapshot", cxxopts::value<std::string>()->default_value(""));
 
     options.parse_positional({ "file" });
 
@@ -74,10 +79,24 @@ int main(int argc, char** argv) {
     auto result = options.parse(argc, (const char**&)argv);
 
     std::string file = result["file"].as<std::string>(),
-        gp = result["generalized"].as<std::string>();
+        gp = result["generalized"].as<std::string>(),
+        method = result["method"].as<std::string>(),
+        save_file = result["save"].as<std::string>();
 
     bool _static = result["static"].as<bool>();
     int width = result["width"].as<int>();
+    set_threads(result["threads"].as<int>());
+
+    BarycenterParams params;
+    params.omega = result["omega"].as<double>();
+    params.tolerance = result["tolerance"].as<double>();
+    if (method == "jacobi") params.method = Relaxation::JACOBI;
+    else if (method == "sor") params.method = Relaxation::SOR;
+    else if (method == "multigrid") params.method = Relaxation::MULTIGRID;
+    else {
+        std::cout << "Unknown method: " << method << std::endl;
+        return 1;
+    }
     TUNGraph graph;
     size_t vertices;
     
@@ -114,13 +133,20 @@ int main(int argc, char** argv) {
     }
 
     std::ofstream graph_out(file);
+    LayoutState final_state(graph);
+    int iterations = 0;
+
     if (_static) {
         auto output = barycenter_layout_la(graph, vertices, width);
         output.image.autoscale();
 
+        final_state = LayoutState(graph, output.pos);
+
         graph_out << std::string(output.image);
         std::cout << "Matrix" << std::endl;
-        std::cout << latex(output.matrix) << std::endl;
+        if (output.matrix.rows() <= 100) std::cout << latex(Eigen::MatrixXd(output.matrix)) << std::endl;
+        else std::cout << "(" << output.matrix.rows() << " x " << output.matrix.cols()
+            << ", " << output.matrix.nonZeros() << " nonzeros: too large to print)" << std::endl;
 
         std::cout << "Fixed vertex positions (x)" << std::endl;
         std::cout << latex('x', output.fixed_x) << std::endl;
@@ -135,10 +161,21 @@ int main(int argc, char** argv) {
         std::cout << latex('y', output.sol_y) << std::endl;
     }
     else {
-        std::vector<SVG::SVG> frames = barycenter_layout(graph, vertices, width);
-        auto final_svg = SVG::frame_animate(frames, 3);
-        graph_out << std::string(final_svg);
+        SMILAnimation animation(graph);
+        barycenter_layout(graph, vertices, width, params, [&](const LayoutState& state, int iteration) {
+            animation.add_frame(state);
+            iterations = iteration;
+            if (!save_file.empty()) {
+                // Only the positions are saved
+                final_state.x = state.x;
+                final_state.y = state.y;
+            }
+        });
+
+        animation.write(graph_out, 3);
     }
 
+    if (!save_file.empty()) write_snapshot(save_file, graph, final_state, iterations);
+
     return 0;
 }
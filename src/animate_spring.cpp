@@ -1,9 +1,8 @@
-#include "csv_parser.h"
 #include "force_directed.h"
 #include "cxxopts.hpp"
+#include <stdio.h>
 
 int main(int argc, char** argv) {
-    using namespace csv;
     using namespace force_directed;
 
     cxxopts::Options options(argv[0], "Animates drawing a complete graph");
@@ -18,16 +17,56 @@ int main(int argc, char** argv) {
         ("t,three_reg", "Draw a three-regular graph")
         ("s,still", "Draw a still drawing of the graph")
         ("r,trace", "Create an algorithm trace of the spring layout")
-        ("g,graph", "Read a CSV file containing edge pairs",
+        ("g,graph", "Read a CSV file containing edge pairs, or a binary edge list made by convert_edges",
             cxxopts::value<std::string>()->default_value(""))
-        ("p,pos", "Read a CSV file containing positions for vertices",
+        ("p,pos", "Read positions for vertices from a CSV file or a layout snapshot",
             cxxopts::value<std::string>()->default_value(""))
+        ("save", "Also save the final positions as a layout snapshot (for --pos)",
+            cxxopts::value<std::string>()->default_value(""))
+        ("float32", "Store coordinates in --save as 32-bit instead of 64-bit floats")
+        ("tiles", "Also cut the final drawing into a pyramid of SVG tiles in this directory",
+            cxxopts::value<std::string>()->default_value(""))
+        ("tile_levels", "Specify the number of zoom levels for --tiles",
+            cxxopts::value<int>()->default_value("6"))
+        ("image", "Also render the final drawing to this PNG (or .ppm) image",
+            cxxopts::value<std::string>()->default_value(""))
+        ("frames", "Also render each animation frame to <frames>0000.png, <frames>0001.png, ...",
+            cxxopts::value<std::string>()->default_value(""))
+        ("pixels", "Specify the width in pixels of --image and --frames",
+            cxxopts::value<int>()->default_value("1000"))
         ("luv", "Specify the parameters of the spring system",
             cxxopts::value<double>()->default_value("400"))
         ("kuv1", "Specify the parameters of the spring system",
             cxxopts::value<double>()->default_value("2"))
         ("kuv2", "Specify the strength of the electrical force between vertices",
-            cxxopts::value<double>()->default_value("1"));
+            cxxopts::value<double>()->default_value("1"))
+        ("repulsion", "How to compute the electrical force: exact, barnes-hut, fmm or grid",
+            cxxopts::value<std::string>()->default_value("exact"))
+        ("theta", "Specify the opening angle for Barnes-Hut (smaller is more accurate)",
+            cxxopts::value<double>()->default_value("0.5"))
+        ("fmm_order", "Specify the expansion order for the FMM (larger is more accurate)",
+            cxxopts::value<int>()->default_value("4"))
+        ("cutoff", "Specify the cutoff radius for --repulsion grid, as a multiple of luv",
+            cxxopts::value<double>()->default_value("2"))
+        ("max_iterations", "Specify the maximum number of iterations",
+            cxxopts::value<int>()->default_value("1000"))
+        ("tolerance", "Stop once the mean distance moved in an iteration is below tolerance * luv",
+            cxxopts::value<double>()->default_value("0.001"))
+        ("cooling", "Specify the factor the step length is cooled by when the layout stops improving",
+            cxxopts::value<double>()->default_value("0.9"))
+        ("threads", "Number of threads for computing forces (0 = OMP_NUM_THREADS, or one per core)",
+            cxxopts::value<int>()->default_value("0"))
+        ("stride", "Only animate every n-th iteration",
+            cxxopts::value<int>()->default_value("1"))
+        ("m,multilevel", "Use the multilevel version of the spring layout")
+        ("stress", "Use stress majorization instead of the spring layout (luv is the edge length)")
+        ("spectral", "Draw the spectral layout instead of running a layout engine")
+        ("init", "How to place vertices before the layout runs: random, pmds (pivot MDS) or spectral",
+            cxxopts::value<std::string>()->default_value("random"))
+        ("seed", "Seed the initial positions (and stress pivots) instead of using the clock",
+            cxxopts::value<int>()->default_value("-1"))
+        ("level_iterations", "Specify the maximum number of iterations per level for --multilevel",
+            cxxopts::value<int>()->default_value("50"));
 
     options.parse_positional({ "file" });
 
@@ -40,56 +79,78 @@ int main(int argc, char** argv) {
     
     std::string file = result["file"].as<std::string>(),
         graph_file = result["graph"].as<std::string>(),
-        pos_file = result["pos"].as<std::string>();
+        pos_file = result["pos"].as<std::string>(),
+        save_file = result["save"].as<std::string>(),
+        tiles_dir = result["tiles"].as<std::string>(),
+        image_file = result["image"].as<std::string>(),
+        frames_prefix = result["frames"].as<std::string>(),
+        repulsion = result["repulsion"].as<std::string>(),
+        init = result["init"].as<std::string>();
 
     bool still = result["still"].as<bool>(),
         side_by_side = result["trace"].as<bool>(),
         cube = result["cube"].as<bool>(),
         tesseract = result["tesseract"].as<bool>(),
-        three_reg = result["three_reg"].as<bool>();
+        three_reg = result["three_reg"].as<bool>(),
+        multilevel = result["multilevel"].as<bool>(),
+        stress = result["stress"].as<bool>(),
+        spectral = result["spectral"].as<bool>();
 
-    int n = result["vertices"].as<int>();
+    int n = result["vertices"].as<int>(),
+        stride = result["stride"].as<int>(),
+        level_iterations = result["level_iterations"].as<int>(),
+        pixels = result["pixels"].as<int>(),
+        seed = result["seed"].as<int>();
 
     ForceDirectedParams params = {
         result["luv"].as<double>(), // 400
         result["kuv1"].as<double>(), // 2
         result["kuv2"].as<double>(), // 1
     };
+    params.theta = result["theta"].as<double>();
+    params.fmm_order = result["fmm_order"].as<int>();
+    params.cutoff = result["cutoff"].as<double>();
+    params.max_iterations = result["max_iterations"].as<int>();
+    params.tolerance = result["tolerance"].as<double>();
+    params.cooling = result["cooling"].as<double>();
+    set_threads(result["threads"].as<int>());
 
     try {
+        if (repulsion == "barnes-hut") params.repulsion = Repulsion::BARNES_HUT;
+        else if (repulsion == "fmm") params.repulsion = Repulsion::FMM;
+        else if (repulsion == "grid") params.repulsion = Repulsion::GRID;
+        else if (repulsion != "exact")
+            throw std::runtime_error("Unknown repulsion mode: " + repulsion);
+
         auto graph_ptr = TSnap::GenFull<PUNGraph>(n);
         auto graph = *graph_ptr;
 
         if (!graph_file.empty()) {
-            CSVReader reader(graph_file);
-            std::vector<CSVField> row;
-            std::set<int> nodes;
-            std::vector<std::pair<int, int>> edges;
-
-            while (reader.read_row(row)) {
-                int first = row[0].get_int(),
-                    second = row[1].get_int();
-
-                nodes.insert(first);
-                nodes.insert(second);
-
-                edges.push_back(std::make_pair(first, second));
-            }
+            if (is_edge_list(graph_file)) read_edge_list(graph_file, graph);
+            else read_edge_csv(graph_file, graph);
+        }
 
-            graph = TUNGraph();
-            for (auto& u : nodes) graph.AddNode(u);
-            for (auto& pair : edges) graph.AddEdge(pair.first, pair.second);
+        if (cube) {
+            graph = hypercube();
         }
+        if (tesseract) graph = hypercube_4();
 
-        VertexPos pos = random_layout(graph);
-        if (!pos_file.empty()) {
-            CSVReader reader(pos_file);
-            std::vector<CSVField> row;
+        SpectralParams spectral_params;
+        spectral_params.edge_length = params.luv;
+        spectral_params.seed = std::max(seed, 0);
 
-            while (reader.read_row(row)) {
-                pos[row[0].get_int()] = std::make_pair(
-                    row[1].get_float(), row[2].get_float());
+        VertexPos pos;
+        if (init == "pmds") pos = pivot_mds_layout(graph, params.luv, 50, std::max(seed, 0));
+        else if (init == "spectral") pos = spectral_layout(spectral_params, graph);
+        else if (init == "random") pos = seed < 0 ? random_layout(graph) : random_layout(graph, seed);
+        else throw std::runtime_error("Unknown initial layout: " + init);
+        if (!pos_file.empty()) {
+            if (is_snapshot(pos_file)) {
+                auto header = read_snapshot(pos_file, pos);
+                if (header.graph_hash != graph_hash(graph))
+                    std::cout << "Warning: " << pos_file << " was saved from a different graph" << std::endl;
             }
+            else read_positions_csv(pos_file, pos);
 
             if (pos.size() < graph.GetNodes()) {
                 throw std::runtime_error("Position file has " +
@@ -99,29 +160,50 @@ int main(int argc, char** argv) {
             }
         }
 
-        if (cube) {
-            graph = hypercube();
-        }
-        if (tesseract) graph = hypercube_4();
         if (three_reg) {
             graph = three_reg_6();
             auto points = SVG::util::polar_points(graph.GetNodes(), 0, 0, 100);
             for (int i = 0; i < graph.GetNodes(); i++) pos[i] = points[i];
         }
 
-        std::vector<SVG::SVG> frames = eades84_2(params, graph, pos);
+        StressParams stress_params;
+        stress_params.edge_length = params.luv;
+        stress_params.seed = std::max(seed, 0);
+
+        int iterations = 0; // Run by the layout engine, for --save
+        auto layout = [&](const FrameCallback& frame, const FrameOptions& options) {
+            auto callback = [&](const LayoutState& state, int iteration) {
+                iterations = iteration;
+                frame(state, iteration);
+            };
+
+            if (spectral) {
+                // Not iterative: the layout is the only frame
+                pos = spectral_layout(spectral_params, graph);
+                callback(LayoutState(graph, pos), 0);
+            }
+            else if (stress)
+                stress_layout(stress_params, graph, pos, callback, options);
+            else if (multilevel)
+                eades84_multilevel(params, graph, pos, callback, options, level_iterations);
+            else
+                eades84_2(params, graph, pos, callback, options);
+        };
 
         if (side_by_side) {
-            const int excess_frames = (int)frames.size() - 16,
-                n_frames = (int)frames.size();
-                
-            // Delete excess frames
-            int i = 0;
-            for (auto it = frames.begin(); it < frames.end();) {
-                if (i > 0 && i%(n_frames/excess_frames) == 0) it = frames.erase(it);
-                else ++it;
-
-                i++;
+            std::vector<SVG::SVG> frames;
+            layout([&](const LayoutState& state, int) {
+                frames.push_back(draw_graph(graph, state));
+            }, FrameOptions());
+
+            // Keep 16 evenly spaced frames, including the first and last. The
+            // layout may converge in fewer, and then every frame is kept.
+            const int TRACE_FRAMES = 16, n_frames = (int)frames.size();
+            if (n_frames > TRACE_FRAMES) {
+                std::vector<SVG::SVG> kept;
+                for (int k = 0; k < TRACE_FRAMES; k++)
+                    kept.push_back(frames[(long long)k * (n_frames - 1) / (TRACE_FRAMES - 1)]);
+                frames.swap(kept);
             }
 
             auto final_svg = SVG::merge(frames, 1000, 250);
@@ -129,15 +211,53 @@ int main(int argc, char** argv) {
             graph_out << std::string(final_svg);
         }
         else if (still) {
-            auto& final_svg = frames.back();
-            final_svg.autoscale();
+            // Only the final positions are needed, and they are streamed
+            // straight to the file
+            FrameOptions options;
+            options.final_only = true;
             std::ofstream graph_out(file);
-            graph_out << std::string(final_svg);
+
+            layout([&](const LayoutState& state, int) {
+                write_svg(graph_out, graph, state);
+            }, options);
         }
         else {
-            auto final_svg = SVG::frame_animate(frames, 5);
+            SMILAnimation animation(graph);
+            FrameOptions options;
+            options.stride = stride;
+
+            layout([&](const LayoutState& state, int) {
+                animation.add_frame(state);
+            }, options);
+
             std::ofstream graph_out(file);
-            graph_out << std::string(final_svg);
+            animation.write(graph_out, 5);
+
+            if (!frames_prefix.empty()) {
+                // Every frame shows the region holding all of them, so the
+                // images all have the same size and scale
+                LayoutState state(graph);
+                const ViewBox box = animation.view_box();
+                for (int frame = 0; frame < animation.frames(); frame++) {
+                    char number[16];
+                    snprintf(number, sizeof number, "%04d", frame);
+                    animation.positions(frame, state);
+                    rasterize(graph, state, box, pixels).save(frames_prefix + number + ".png");
+                }
+            }
+        }
+
+        if (!save_file.empty())
+            write_snapshot(save_file, graph, LayoutState(graph, pos), iterations,
+                result["float32"].as<bool>() ? 4 : 8);
+
+        if (!image_file.empty()) rasterize(graph, LayoutState(graph, pos), pixels).save(image_file);
+
+        if (!tiles_dir.empty()) {
+            TileParams tile_params;
+            tile_params.levels = result["tile_levels"].as<int>();
+            std::cout << "Wrote " << write_tiles(tiles_dir, graph, LayoutState(graph, pos), tile_params)
+                << " tiles" << std::endl;
         }
     }
     catch (std::runtime_error& err) {
@@ -0,0 +1,306 @@
+#include "force_directed.h"
+#include <algorithm>
+#include <memory>
+
+namespace force_directed {
+    namespace barycenter_helper {
+        std::vector<std::vector<int>> color_classes(const CSRAdjacency& adjacent, int n_fixed) {
+            /** Greedily color the free vertices (n_fixed, n_fixed + 1, ...) so that
+             *  no two free neighbors share a color, and group them by color.
+             *  Bipartite graphs like grids and prisms of even order get the
+             *  red-black ordering.
+             */
+            const int n = adjacent.size();
+            std::vector<int> color(n, -1), used; // used[c] == u: some neighbor of u has color c
+            std::vector<std::vector<int>> classes;
+
+            for (int u = n_fixed; u < n; u++) {
+                for (auto v = adjacent.begin(u); v != adjacent.end(u); v++)
+                    if (color[*v] >= 0) used[color[*v]] = u;
+
+                int c = 0;
+                while (c < (int)used.size() && used[c] == u) c++;
+                if (c == (int)used.size()) {
+                    used.push_back(-1);
+                    classes.emplace_back();
+                }
+
+                color[u] = c;
+                classes[c].push_back(u);
+            }
+
+            return classes;
+        }
+
+        double residual(const CSRAdjacency& adjacent, int n_fixed, const LayoutState& state) {
+            /** Norm of sum of neighbors - deg(u) p_u over every free vertex u */
+            double sum = 0;
+
+            #pragma omp parallel for reduction(+:sum)
+            for (int u = n_fixed; u < adjacent.size(); u++) {
+                double rx = -adjacent.degree(u) * state.x[u], ry = -adjacent.degree(u) * state.y[u];
+                for (auto v = adjacent.begin(u); v != adjacent.end(u); v++) {
+                    rx += state.x[*v];
+                    ry += state.y[*v];
+                }
+
+                sum += rx * rx + ry * ry;
+            }
+
+            return sqrt(sum);
+        }
+
+        static std::vector<int> aggregate(const SparseMatrix& a, int& count) {
+            /** Group each vertex with its neighbors (off-diagonal nonzeros):
+             *  first around roots with no aggregated neighbors, then by
+             *  joining the aggregate of the most strongly connected neighbor
+             */
+            const int n = (int)a.rows();
+            std::vector<int> agg(n, -1);
+            count = 0;
+
+            for (int u = 0; u < n; u++) {
+                if (agg[u] >= 0) continue;
+
+                bool untouched = true;
+                for (SparseMatrix::InnerIterator it(a, u); it; ++it)
+                    if (agg[it.row()] >= 0) untouched = false;
+                if (!untouched) continue;
+
+                for (SparseMatrix::InnerIterator it(a, u); it; ++it) agg[it.row()] = count;
+                agg[u] = count++;
+            }
+
+            std::vector<int> roots = agg;
+            for (int u = 0; u < n; u++) {
+                if (agg[u] >= 0) continue;
+
+                double strongest = 0;
+                for (SparseMatrix::InnerIterator it(a, u); it; ++it) {
+                    if (it.row() != u && roots[it.row()] >= 0 && std::abs(it.value()) > strongest) {
+                        strongest = std::abs(it.value());
+                        agg[u] = roots[it.row()];
+                    }
+                }
+
+                if (agg[u] < 0) agg[u] = count++; // Isolated
+            }
+
+            return agg;
+        }
+
+        Multigrid::Multigrid(const SparseMatrix& matrix) {
+            /** Coarsen until the system is small enough to factor. Each level's
+             *  interpolation is the piecewise constant one over the
+             *  aggregates, smoothed by a step of damped Jacobi.
+             */
+            a.push_back(matrix);
+
+            while (a.back().rows() > COARSEST) {
+                const SparseMatrix& fine = a.back();
+                const int n = (int)fine.rows();
+
+                // Gershgorin bound on the spectral radius of D^-1 A
+                VectorXd diagonal = VectorXd::Zero(n), offdiagonal = VectorXd::Zero(n);
+                for (int u = 0; u < n; u++) {
+                    for (SparseMatrix::InnerIterator it(fine, u); it; ++it) {
+                        if (it.row() == u) diagonal(u) = it.value();
+                        else offdiagonal(it.row()) += std::abs(it.value());
+                    }
+                }
+
+                double rho = 1;
+                for (int u = 0; u < n; u++)
+                    if (diagonal(u) > 0) rho = std::max(rho, 1 + offdiagonal(u) / diagonal(u));
+
+                const double omega = 4 / (3 * rho);
+                VectorXd w(n);
+                for (int u = 0; u < n; u++) w(u) = diagonal(u) > 0 ? omega / diagonal(u) : 0;
+
+                int count;
+                std::vector<int> agg = aggregate(fine, count);
+                if (count > 0.8 * n) break; // Aggregation stopped helping
+
+                std::vector<Eigen::Triplet<double>> triplets;
+                for (int u = 0; u < n; u++) triplets.emplace_back(u, agg[u], 1.0);
+                SparseMatrix tentative(n, count);
+                tentative.setFromTriplets(triplets.begin(), triplets.end());
+
+                SparseMatrix smoothed = tentative - SparseMatrix(w.asDiagonal() * fine) * tentative;
+                SparseMatrix coarse = SparseMatrix(smoothed.transpose()) * fine * smoothed;
+
+                weight.push_back(std::move(w));
+                p.push_back(std::move(smoothed));
+                a.push_back(std::move(coarse));
+            }
+
+            coarsest.compute(a.back());
+            if (coarsest.info() != Eigen::Success)
+                throw std::runtime_error("Barycenter system is singular (is every component attached to a fixed vertex?)");
+        }
+
+        void Multigrid::smooth(int level, const MatrixXd& b, MatrixXd& x) const {
+            for (int s = 0; s < 2; s++) {
+                MatrixXd r = b - a[level] * x;
+                x += weight[level].asDiagonal() * r;
+            }
+        }
+
+        void Multigrid::cycle(int level, const MatrixXd& b, MatrixXd& x) const {
+            if (level == levels() - 1) {
+                x = coarsest.solve(b);
+                return;
+            }
+
+            smooth(level, b, x);
+
+            // Correct with the solution for the residual on the next level
+            MatrixXd r = p[level].transpose() * (b - a[level] * x),
+                e = MatrixXd::Zero(r.rows(), r.cols());
+            cycle(level + 1, r, e);
+            x += p[level] * e;
+
+            smooth(level, b, x);
+        }
+    }
+
+    void barycenter_layout(TUNGraph& graph, const size_t fixed_vertices, const double width,
+        BarycenterParams& params, const FrameCallback& callback, const FrameOptions& options) {
+        /** Iteratively solve the barycenter layout problem with params.method,
+         *  stopping once the norm of the residual (the distance of every free
+         *  vertex from the barycenter of its neighbors, weighted by degree)
+         *  has fallen by a factor of params.tolerance
+         */
+        using namespace barycenter_helper;
+
+        LayoutState state(graph); // Free vertices start at origin
+        FrameRecorder frames(callback, options);
+        const int n = state.size(), n_fixed = (int)std::min(fixed_vertices, (size_t)n),
+            n_free = n - n_fixed;
+
+        // The first fixed_vertices vertices are placed along the polygon
+        std::vector<Point> polygon = SVG::util::polar_points((int)fixed_vertices, 0, 0, width / 2);
+        for (int u = 0; u < n_fixed; u++) {
+            state.x[u] = polygon[u].first;
+            state.y[u] = polygon[u].second;
+        }
+
+        frames.record(state, 0);
+        CSRAdjacency adjacent(graph, state);
+
+        std::function<void()> iterate;
+        std::vector<double> new_x, new_y;
+        std::vector<std::vector<int>> classes;
+        SparseMatrix a, b;
+        std::unique_ptr<Multigrid> multigrid;
+        MatrixXd solution, r, z, direction;
+        VectorXd rz;
+
+        if (params.method == Relaxation::JACOBI) {
+            new_x = state.x;
+            new_y = state.y;
+
+            iterate = [&]() {
+                #pragma omp parallel for
+                for (int u = n_fixed; u < n; u++) {
+                    if (adjacent.degree(u) == 0) continue;
+
+                    double sum_x = 0, sum_y = 0;
+                    for (auto v = adjacent.begin(u); v != adjacent.end(u); v++) {
+                        sum_x += state.x[*v];
+                        sum_y += state.y[*v];
+                    }
+
+                    new_x[u] = sum_x / adjacent.degree(u);
+                    new_y[u] = sum_y / adjacent.degree(u);
+                }
+
+                std::swap(state.x, new_x);
+                std::swap(state.y, new_y);
+            };
+        }
+        else if (params.method == Relaxation::SOR) {
+            // Vertices of one color have no free neighbors in common, so each
+            // color class is updated in parallel
+            classes = color_classes(adjacent, n_fixed);
+
+            iterate = [&]() {
+                for (auto& members : classes) {
+                    #pragma omp parallel for
+                    for (int k = 0; k < (int)members.size(); k++) {
+                        const int u = members[k];
+                        if (adjacent.degree(u) == 0) continue;
+
+                        double sum_x = 0, sum_y = 0;
+                        for (auto v = adjacent.begin(u); v != adjacent.end(u); v++) {
+                            sum_x += state.x[*v];
+                            sum_y += state.y[*v];
+                        }
+
+                        state.x[u] += params.omega * (sum_x / adjacent.degree(u) - state.x[u]);
+                        state.y[u] += params.omega * (sum_y / adjacent.degree(u) - state.y[u]);
+                    }
+                }
+            };
+        }
+        else {
+            // Conjugate gradients on x and y (the columns), preconditioned by a
+            // V-cycle. V-cycles alone need more and more cycles as the mesh
+            // grows, and conjugate gradients make up for the modes they miss.
+            system(adjacent, n_fixed, a, b);
+            multigrid.reset(new Multigrid(a));
+
+            MatrixXd fixed_pos(n_fixed, 2);
+            for (int u = 0; u < n_fixed; u++) {
+                fixed_pos(u, 0) = state.x[u];
+                fixed_pos(u, 1) = state.y[u];
+            }
+
+            solution = MatrixXd::Zero(n_free, 2);
+            r = b * fixed_pos;
+            z = MatrixXd::Zero(n_free, 2);
+            multigrid->cycle(r, z);
+            direction = z;
+            rz = r.cwiseProduct(z).colwise().sum().transpose();
+
+            iterate = [&]() {
+                MatrixXd q = a * direction;
+                for (int j = 0; j < 2; j++) {
+                    double dq = direction.col(j).dot(q.col(j));
+                    if (dq <= 0) continue; // Already solved
+
+                    double alpha = rz(j) / dq;
+                    solution.col(j) += alpha * direction.col(j);
+                    r.col(j) -= alpha * q.col(j);
+                }
+
+                z.setZero();
+                multigrid->cycle(r, z);
+                for (int j = 0; j < 2; j++) {
+                    double updated = r.col(j).dot(z.col(j));
+                    direction.col(j) = z.col(j) + (rz(j) > 0 ? updated / rz(j) : 0) * direction.col(j);
+                    rz(j) = updated;
+                }
+
+                for (int i = 0; i < n_free; i++) {
+                    state.x[n_fixed + i] = solution(i, 0);
+                    state.y[n_fixed + i] = solution(i, 1);
+                }
+            };
+        }
+
+        const double initial = residual(adjacent, n_fixed, state);
+        bool converge = initial == 0;
+        int it = 0;
+
+        while (!converge && it < params.max_iterations) {
+            iterate();
+
+            // Algorithm trace
+            frames.record(state, ++it);
+            converge = residual(adjacent, n_fixed, state) <= params.tolerance * initial;
+        }
+
+        frames.finish(state, it);
+    }
+}
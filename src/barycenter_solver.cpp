@@ -0,0 +1,86 @@
+#include "force_directed.h"
+#include <algorithm>
+
+namespace force_directed {
+    namespace barycenter_helper {
+        void system(const CSRAdjacency& adjacent, int n_fixed, SparseMatrix& free, SparseMatrix& coupling) {
+            /** Barycenter equations for vertices n_fixed, n_fixed + 1, ...:
+             *  free gets their degrees minus their adjacency among themselves,
+             *  and coupling a 1 for each fixed neighbor. A free vertex with no
+             *  neighbors has no barycenter, so its equation just keeps it at
+             *  the origin, as the Jacobi and SOR sweeps do.
+             */
+            const int n_free = adjacent.size() - n_fixed;
+            std::vector<Eigen::Triplet<double>> free_triplets, fixed_triplets;
+            free_triplets.reserve(adjacent.neighbors.size() + n_free);
+
+            for (int i = 0; i < n_free; i++) {
+                const int u = n_fixed + i;
+                free_triplets.emplace_back(i, i, std::max(adjacent.degree(u), 1));
+
+                for (auto v = adjacent.begin(u); v != adjacent.end(u); v++) {
+                    if (*v >= n_fixed) free_triplets.emplace_back(i, *v - n_fixed, -1.0);
+                    else fixed_triplets.emplace_back(i, *v, 1.0);
+                }
+            }
+
+            free.resize(n_free, n_free);
+            free.setFromTriplets(free_triplets.begin(), free_triplets.end());
+            coupling.resize(n_free, n_fixed);
+            coupling.setFromTriplets(fixed_triplets.begin(), fixed_triplets.end());
+        }
+    }
+
+    BarycenterSolver::BarycenterSolver(TUNGraph& graph, const size_t fixed_vertices) :
+        state(graph), n_fixed((int)std::min(fixed_vertices, (size_t)graph.GetNodes())) {
+        /** Every free vertex sits at the average of its neighbors, i.e.
+         *
+         *      deg(u) p_u - sum of free neighbors p_v = sum of fixed neighbors p_v
+         *
+         *  The left hand side (a) is sparse, symmetric and (as long as every
+         *  component with an edge has a fixed vertex) positive definite, so it
+         *  is factored once with a sparse LDL^T. Free vertex i is vertex
+         *  n_fixed + i, and isolated free vertices are put at the origin.
+         */
+        CSRAdjacency adjacent(graph, state);
+        barycenter_helper::system(adjacent, n_fixed, a, b);
+
+        ldlt.compute(a);
+        if (ldlt.info() != Eigen::Success)
+            throw std::runtime_error("Barycenter system is singular (is every component attached to a fixed vertex?)");
+    }
+
+    void BarycenterSolver::solve(const MatrixXd& fixed_x, const MatrixXd& fixed_y,
+        MatrixXd& free_x, MatrixXd& free_y) const {
+        // Right hand sides: sum up fixed vertices adjacent to each free vertex
+        MatrixXd rhs_x = b * fixed_x, rhs_y = b * fixed_y;
+        const int k = (int)fixed_x.cols();
+        free_x.resize(free_count(), k);
+        free_y.resize(free_count(), k);
+
+        // Solving only reads the factorization, so columns are independent
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (int j = 0; j < 2 * k; j++) {
+            if (j < k) free_x.col(j) = ldlt.solve(VectorXd(rhs_x.col(j)));
+            else free_y.col(j - k) = ldlt.solve(VectorXd(rhs_y.col(j - k)));
+        }
+    }
+
+    VertexPos BarycenterSolver::layout(const std::vector<Point>& fixed_pos) const {
+        /** Positions of every vertex, given the fixed vertices' positions in order */
+        MatrixXd fixed_x(n_fixed, 1), fixed_y(n_fixed, 1), free_x, free_y;
+        for (int u = 0; u < n_fixed; u++) {
+            fixed_x(u, 0) = fixed_pos[u].first;
+            fixed_y(u, 0) = fixed_pos[u].second;
+        }
+
+        solve(fixed_x, fixed_y, free_x, free_y);
+
+        VertexPos pos;
+        for (int u = 0; u < n_fixed; u++) pos[id(u)] = fixed_pos[u];
+        for (int i = 0; i < free_count(); i++)
+            pos[id(n_fixed + i)] = std::make_pair(free_x(i, 0), free_y(i, 0));
+
+        return pos;
+    }
+}
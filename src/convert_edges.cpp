@@ -0,0 +1,41 @@
+#include "force_directed.h"
+#include "cxxopts.hpp"
+
+int main(int argc, char** argv) {
+    using namespace force_directed;
+
+    cxxopts::Options options(argv[0], "Converts a CSV file of edge pairs into a binary edge list");
+    options.positional_help("[input file] [output file]");
+    options.add_options("required")
+        ("input", "CSV file containing edge pairs", cxxopts::value<std::string>())
+        ("output", "Binary edge list to write", cxxopts::value<std::string>());
+    options.add_options("optional")
+        ("int64", "Store vertex ids as 64-bit instead of 32-bit integers");
+
+    options.parse_positional({ "input", "output" });
+
+    if (argc < 3) {
+        std::cout << options.help({ "required", "optional" }) << std::endl;
+        return 1;
+    }
+
+    auto result = options.parse(argc, (const char**&)argv);
+
+    try {
+        // Edges are written as they appear in the CSV, a chunk at a time
+        EdgeListWriter writer(result["output"].as<std::string>(),
+            result["int64"].as<bool>() ? 8 : 4);
+        read_edge_csv(result["input"].as<std::string>(), [&](const std::vector<long long>& endpoints) {
+            for (size_t i = 0; i + 1 < endpoints.size(); i += 2) writer.add(endpoints[i], endpoints[i + 1]);
+        });
+
+        writer.close();
+        std::cout << "Wrote " << writer.size() << " edges" << std::endl;
+    }
+    catch (std::runtime_error& err) {
+        std::cout << err.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
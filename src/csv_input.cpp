@@ -0,0 +1,255 @@
+#include "force_directed.h"
+#include "mapped_file.h"
+#include <algorithm>
+#include <limits.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace force_directed {
+    namespace csv_helper {
+        bool next_field(const char*& p, const char* end, const char*& begin, const char*& finish) {
+            /** Find the next comma separated field of the line [p, end), trimmed
+             *  of whitespace and quotes, and move p past it. Returns false if
+             *  the line has no fields left.
+             */
+            if (p > end) return false;
+
+            const char* comma = std::find(p, end, ',');
+            begin = p;
+            finish = comma;
+            p = comma + 1; // Past end on the last field
+
+            while (begin < finish && (*begin == ' ' || *begin == '\t' || *begin == '"')) begin++;
+            while (finish > begin && (finish[-1] == ' ' || finish[-1] == '\t' ||
+                finish[-1] == '"' || finish[-1] == '\r')) finish--;
+            return true;
+        }
+
+        bool parse_int(const char* begin, const char* end, long long& value) {
+            /** Parse all of [begin, end) as a decimal integer */
+            bool negative = begin < end && *begin == '-';
+            if (begin < end && (*begin == '-' || *begin == '+')) begin++;
+            if (begin == end || end - begin > 18) return false;
+
+            value = 0;
+            for (; begin < end; begin++) {
+                if (*begin < '0' || *begin > '9') return false;
+                value = 10 * value + (*begin - '0');
+            }
+
+            if (negative) value = -value;
+            return true;
+        }
+
+        static bool parse_id(const char* begin, const char* end, long long max_id, long long& value) {
+            /** Parse all of [begin, end) as a vertex id from 0 to max_id */
+            return parse_int(begin, end, value) && value >= 0 && value <= max_id;
+        }
+
+        bool parse_double(const char* begin, const char* end, double& value) {
+            /** Parse all of [begin, end) as a decimal number with an optional
+             *  fraction and exponent. Digits past the 19th significant one
+             *  are dropped, which is well below the precision of a position.
+             */
+            bool negative = begin < end && *begin == '-', digits = false;
+            if (begin < end && (*begin == '-' || *begin == '+')) begin++;
+
+            unsigned long long mantissa = 0;
+            int significant = 0, exponent = 0;
+            auto digit = [&](char c, bool fraction) {
+                digits = true;
+                if (mantissa == 0 && c == '0') {
+                    if (fraction) exponent--;
+                    return;
+                }
+
+                if (significant < 19) {
+                    mantissa = 10 * mantissa + (c - '0');
+                    significant++;
+                    if (fraction) exponent--;
+                }
+                else if (!fraction) exponent++;
+            };
+
+            for (; begin < end && *begin >= '0' && *begin <= '9'; begin++) digit(*begin, false);
+            if (begin < end && *begin == '.')
+                for (begin++; begin < end && *begin >= '0' && *begin <= '9'; begin++) digit(*begin, true);
+            if (!digits) return false;
+
+            if (begin < end && (*begin == 'e' || *begin == 'E')) {
+                long long power;
+                if (!parse_int(begin + 1, end, power) || power > 400 || power < -400) return false;
+                exponent += (int)power;
+                begin = end;
+            }
+
+            if (begin != end) return false;
+
+            value = (double)mantissa;
+            if (exponent > 0) value *= pow(10.0, exponent);
+            else if (exponent < 0) value /= pow(10.0, -exponent);
+            if (negative) value = -value;
+            return true;
+        }
+
+        std::vector<std::pair<size_t, size_t>> chunks(const char* data, size_t size, size_t start) {
+            /** Split [start, size) into byte ranges for parsing in parallel, each
+             *  ending just past a newline (or at the end of the file)
+             */
+#ifdef _OPENMP
+            const size_t threads = omp_get_max_threads();
+#else
+            const size_t threads = 1;
+#endif
+            const size_t MIN_CHUNK = 1 << 20,
+                count = std::max((size_t)1, std::min(8 * threads, (size - start) / MIN_CHUNK));
+
+            std::vector<std::pair<size_t, size_t>> ranges;
+            size_t begin = start;
+            for (size_t c = 1; c <= count && begin < size; c++) {
+                size_t finish = c == count ? size : std::max(begin, start + (size - start) * c / count);
+                const char* newline = std::find(data + finish, data + size, '\n');
+                finish = std::min(size, (size_t)(newline - data) + 1);
+
+                ranges.push_back(std::make_pair(begin, finish));
+                begin = finish;
+            }
+
+            return ranges;
+        }
+
+        template<typename Buffer, typename Parse>
+        static void parse_lines(const std::string& file, const MappedFile& mapped,
+            std::vector<Buffer>& buffers, Parse parse) {
+            /** Call parse(buffer, begin, end) on every non-blank line, with one
+             *  buffer per chunk and the chunks parsed in parallel. Like
+             *  CSVReader, the first line is taken to be column names, but only
+             *  if it doesn't parse.
+             */
+            const char* data = mapped.data();
+            const size_t size = mapped.size();
+            buffers.clear();
+            if (size == 0) return;
+
+            size_t start = 0;
+            const char* first_end = std::find(data, data + size, '\n');
+            Buffer scratch;
+            if (!parse(scratch, data, first_end)) start = std::min(size, (size_t)(first_end - data) + 1);
+
+            auto ranges = chunks(data, size, start);
+            buffers.resize(ranges.size());
+            std::vector<long long> bad(ranges.size(), -1); // First unparsed byte offset in each chunk
+
+            #pragma omp parallel for schedule(dynamic, 1)
+            for (int c = 0; c < (int)ranges.size(); c++) {
+                const char* p = data + ranges[c].first, *end = data + ranges[c].second;
+                while (p < end) {
+                    const char* line_end = std::find(p, end, '\n');
+                    const char* q = p;
+                    while (q < line_end && (*q == ' ' || *q == '\t' || *q == '\r')) q++;
+
+                    if (q < line_end && !parse(buffers[c], p, line_end)) {
+                        bad[c] = p - data;
+                        break;
+                    }
+
+                    p = line_end + 1;
+                }
+            }
+
+            for (long long offset : bad) {
+                if (offset >= 0) throw std::runtime_error("Could not parse the line at byte " +
+                    std::to_string(offset) + " of " + file);
+            }
+        }
+    }
+
+    template<typename Id>
+    static void parse_edges(const std::string& file, const MappedFile& mapped,
+        std::vector<std::vector<Id>>& endpoints, const long long max_id) {
+        /** Parse the lines of an edge CSV into one buffer of endpoint pairs per chunk */
+        using namespace csv_helper;
+        parse_lines(file, mapped, endpoints, [max_id](std::vector<Id>& buffer, const char* p, const char* end) {
+            const char *begin, *finish;
+            long long u, v;
+            if (!next_field(p, end, begin, finish) || !parse_id(begin, finish, max_id, u) ||
+                !next_field(p, end, begin, finish) || !parse_id(begin, finish, max_id, v)) return false;
+
+            buffer.push_back((Id)u);
+            buffer.push_back((Id)v);
+            return true;
+        });
+    }
+
+    void read_edge_csv(const std::string& file, TUNGraph& graph) {
+        /** Replace graph with the graph in a CSV file with one edge (two
+         *  vertex ids) per line. The file is memory mapped and parsed in
+         *  chunks in parallel.
+         */
+        MappedFile mapped(file);
+        std::vector<std::vector<int>> endpoints;
+        parse_edges(file, mapped, endpoints, INT_MAX);
+
+        // Concatenate the per-chunk buffers in file order
+        std::vector<size_t> offset(endpoints.size() + 1, 0);
+        for (size_t c = 0; c < endpoints.size(); c++) offset[c + 1] = offset[c] + endpoints[c].size();
+
+        std::vector<int> all(offset.back());
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (int c = 0; c < (int)endpoints.size(); c++) {
+            std::copy(endpoints[c].begin(), endpoints[c].end(), all.begin() + offset[c]);
+            std::vector<int>().swap(endpoints[c]);
+        }
+
+        graph_from_edges(all, graph);
+    }
+
+    void read_edge_csv(const std::string& file, const EdgeChunkCallback& callback) {
+        /** Parse a CSV file of edges like read_edge_csv() above, but without
+         *  building a graph: callback() gets the endpoints u1, v1, u2, v2, ...
+         *  of each chunk in file order, duplicates and all. Each buffer is
+         *  freed once callback() returns.
+         */
+        MappedFile mapped(file);
+        std::vector<std::vector<long long>> endpoints;
+        parse_edges(file, mapped, endpoints, LLONG_MAX);
+
+        for (auto& chunk : endpoints) {
+            callback(chunk);
+            std::vector<long long>().swap(chunk);
+        }
+    }
+
+    void read_positions_csv(const std::string& file, VertexPos& pos) {
+        /** Read lines of vertex id, x, y from a CSV file into pos, in parallel
+         *  like read_edge_csv(), which accepts the same ids (0 to INT_MAX).
+         *  Later lines for the same vertex win.
+         */
+        using namespace csv_helper;
+        struct Row {
+            int id;
+            double x, y;
+        };
+
+        MappedFile mapped(file);
+        std::vector<std::vector<Row>> rows;
+
+        parse_lines(file, mapped, rows, [](std::vector<Row>& buffer, const char* p, const char* end) {
+            const char *begin, *finish;
+            long long id;
+            Row row;
+            if (!next_field(p, end, begin, finish) || !parse_id(begin, finish, INT_MAX, id) ||
+                !next_field(p, end, begin, finish) || !parse_double(begin, finish, row.x) ||
+                !next_field(p, end, begin, finish) || !parse_double(begin, finish, row.y)) return false;
+
+            row.id = (int)id;
+            buffer.push_back(row);
+            return true;
+        });
+
+        for (auto& buffer : rows)
+            for (auto& row : buffer) pos[row.id] = std::make_pair(row.x, row.y);
+    }
+}
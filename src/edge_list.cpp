@@ -0,0 +1,221 @@
+#include "force_directed.h"
+#include "mapped_file.h"
+#include <algorithm>
+#include <limits.h>
+#include <stddef.h>
+#include <string.h>
+
+namespace force_directed {
+    static const char EDGE_LIST_MAGIC[8] = "FDEDGES";
+
+    static EdgeListHeader edge_list_header(int width, uint64_t edges) {
+        EdgeListHeader header = {};
+        memcpy(header.magic, EDGE_LIST_MAGIC, sizeof header.magic);
+        header.version = 1;
+        header.width = (uint32_t)width;
+        header.edges = edges;
+        return header;
+    }
+
+    EdgeListWriter::EdgeListWriter(const std::string& file, int width) :
+        out(file, std::ios::binary), file(file), width(width) {
+        /** Start a binary edge list with vertex ids width (4 or 8) bytes wide */
+        if (!out) throw std::runtime_error("Could not open " + file);
+        if (width != 4 && width != 8) throw std::runtime_error("Vertex ids must be 4 or 8 bytes wide");
+        if (!little_endian_host()) throw std::runtime_error("Binary edge lists need a little-endian machine");
+
+        // Placeholder header without the magic, so the file isn't an edge
+        // list until close() succeeds
+        EdgeListHeader header = {};
+        out.write((const char*)&header, sizeof header);
+    }
+
+    EdgeListWriter::~EdgeListWriter() {
+        // Not closed (e.g. unwinding from an error): leave the placeholder header
+        if (out.is_open()) out.close();
+    }
+
+    void EdgeListWriter::add(long long u, long long v) {
+        if (width == 4) {
+            if (u < INT32_MIN || u > INT32_MAX || v < INT32_MIN || v > INT32_MAX)
+                throw std::runtime_error("Vertex id does not fit in 4 bytes");
+
+            int32_t pair[2] = { (int32_t)u, (int32_t)v };
+            out.write((const char*)pair, sizeof pair);
+        }
+        else {
+            int64_t pair[2] = { (int64_t)u, (int64_t)v };
+            out.write((const char*)pair, sizeof pair);
+        }
+
+        if (!out) throw std::runtime_error("Could not write " + file);
+        edges++;
+    }
+
+    void EdgeListWriter::close() {
+        /** Write the real header, making the file a valid edge list */
+        if (!out) throw std::runtime_error("Could not write " + file);
+
+        EdgeListHeader header = edge_list_header(width, edges);
+        out.seekp(0);
+        out.write((const char*)&header, sizeof header);
+        out.close();
+        if (!out) throw std::runtime_error("Could not write " + file);
+    }
+
+    bool is_edge_list(const std::string& file) {
+        /** Whether file starts like a binary edge list (as opposed to a CSV) */
+        std::ifstream in(file, std::ios::binary);
+        char magic[sizeof EDGE_LIST_MAGIC] = {};
+        in.read(magic, sizeof magic);
+        return in && memcmp(magic, EDGE_LIST_MAGIC, sizeof magic) == 0;
+    }
+
+    template<typename Id>
+    static void fill_graph(const Id* ids, size_t edges, TUNGraph& graph) {
+        /** ids holds the endpoints of each edge in turn. The edges are counting
+         *  sorted into CSR rows by dense vertex index, and then the graph is
+         *  filled in one row at a time, without the sorted inserts and
+         *  duplicate checks of AddEdge().
+         */
+        const long long m = (long long)edges, count = 2 * m;
+        if (m == 0) {
+            graph = TUNGraph();
+            return;
+        }
+
+        long long min_id = LLONG_MAX, max_id = LLONG_MIN;
+        #pragma omp parallel for reduction(min:min_id) reduction(max:max_id)
+        for (long long k = 0; k < count; k++) {
+            min_id = std::min(min_id, (long long)ids[k]);
+            max_id = std::max(max_id, (long long)ids[k]);
+        }
+
+        if (min_id < 0 || max_id > INT_MAX)
+            throw std::runtime_error("Vertex ids must be between 0 and " + std::to_string(INT_MAX));
+
+        // Dense indices in increasing id order: from a table when the ids are
+        // compact enough, otherwise by sorting them
+        std::vector<int> nodes, table;
+        const bool compact = max_id - min_id < 4 * count + 1024;
+        if (compact) {
+            table.assign((size_t)(max_id - min_id + 1), -1);
+
+            #pragma omp parallel for
+            for (long long k = 0; k < count; k++) table[ids[k] - min_id] = 0;
+
+            for (size_t i = 0; i < table.size(); i++) {
+                if (table[i] < 0) continue;
+                table[i] = (int)nodes.size();
+                nodes.push_back((int)(i + min_id));
+            }
+        }
+        else {
+            nodes.assign(ids, ids + count);
+            std::sort(nodes.begin(), nodes.end());
+            nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+        }
+
+        auto dense = [&](long long id) {
+            return compact ? table[id - min_id] :
+                (int)(std::lower_bound(nodes.begin(), nodes.end(), (int)id) - nodes.begin());
+        };
+
+        // Each edge goes in both endpoints' rows (a self-loop only once)
+        const int n = (int)nodes.size();
+        std::vector<long long> offsets(n + 1, 0);
+
+        #pragma omp parallel for
+        for (long long e = 0; e < m; e++) {
+            const int u = dense(ids[2 * e]), v = dense(ids[2 * e + 1]);
+            #pragma omp atomic
+            offsets[u + 1]++;
+            if (u != v) {
+                #pragma omp atomic
+                offsets[v + 1]++;
+            }
+        }
+
+        for (int u = 0; u < n; u++) offsets[u + 1] += offsets[u];
+
+        std::vector<long long> fill(offsets.begin(), offsets.end() - 1);
+        std::vector<int> neighbors((size_t)offsets[n]);
+
+        #pragma omp parallel for
+        for (long long e = 0; e < m; e++) {
+            const int u = dense(ids[2 * e]), v = dense(ids[2 * e + 1]);
+            long long slot;
+            #pragma omp atomic capture
+            slot = fill[u]++;
+            neighbors[slot] = v;
+
+            if (u != v) {
+                #pragma omp atomic capture
+                slot = fill[v]++;
+                neighbors[slot] = u;
+            }
+        }
+
+        // Sort each row and drop repeated edges
+        std::vector<int> degree(n);
+        #pragma omp parallel for schedule(dynamic, 1024)
+        for (int u = 0; u < n; u++) {
+            auto begin = neighbors.begin() + offsets[u], end = neighbors.begin() + offsets[u + 1];
+            std::sort(begin, end);
+            degree[u] = (int)(std::unique(begin, end) - begin);
+        }
+
+        // Adding each edge from its lower endpoint, in increasing id order,
+        // appends to every neighbor list in sorted order
+        graph = TUNGraph();
+        graph.Reserve(n, (int)std::min(m, (long long)INT_MAX));
+        for (int u = 0; u < n; u++) {
+            graph.AddNode(nodes[u]);
+            graph.ReserveNIdDeg(nodes[u], degree[u]);
+        }
+
+        for (int u = 0; u < n; u++) {
+            for (long long k = offsets[u]; k < offsets[u] + degree[u]; k++) {
+                const int v = neighbors[k];
+                if (v >= u) graph.AddEdgeUnchecked(nodes[u], nodes[v]);
+            }
+        }
+    }
+
+    void read_edge_list(const std::string& file, TUNGraph& graph) {
+        /** Replace graph with the graph in a binary edge list file, which is
+         *  memory mapped and read in place
+         */
+        if (!little_endian_host()) throw std::runtime_error("Binary edge lists need a little-endian machine");
+
+        MappedFile mapped(file);
+        EdgeListHeader header;
+        if (mapped.size() < sizeof header) throw std::runtime_error(file + " is too short to be an edge list");
+
+        memcpy(&header, mapped.data(), sizeof header);
+        if (memcmp(header.magic, EDGE_LIST_MAGIC, sizeof header.magic) != 0)
+            throw std::runtime_error(file + " is not a binary edge list");
+        if (header.version != 1)
+            throw std::runtime_error(file + " has unsupported edge list version " + std::to_string(header.version));
+        if (header.width != 4 && header.width != 8)
+            throw std::runtime_error(file + " has unsupported vertex id width " + std::to_string(header.width));
+        // Bound the count by the file size before multiplying, so a corrupt
+        // header can't overflow the size check
+        if (header.edges > mapped.size() / (2 * header.width))
+            throw std::runtime_error(file + " should hold " + std::to_string(header.edges) + " edges but is too short");
+        if (mapped.size() != sizeof header + 2 * (size_t)header.width * (size_t)header.edges)
+            throw std::runtime_error(file + " should hold " + std::to_string(header.edges) + " edges but has the wrong size");
+
+        // The header is 8 byte aligned and the mapping page aligned, so ids can be read in place
+        const char* body = mapped.data() + sizeof header;
+        if (header.width == 4) fill_graph((const int32_t*)body, (size_t)header.edges, graph);
+        else fill_graph((const int64_t*)body, (size_t)header.edges, graph);
+    }
+
+    void graph_from_edges(const std::vector<int>& endpoints, TUNGraph& graph) {
+        /** Replace graph with the graph on the edges endpoints[0] - endpoints[1],
+         *  endpoints[2] - endpoints[3], ...
+         */
+        fill_graph(endpoints.data(), endpoints.size() / 2, graph);
+    }
+}
@@ -0,0 +1,294 @@
+#include "fmm.h"
+#include <algorithm>
+#include <math.h>
+#include <stdexcept>
+#include <string>
+
+namespace force_directed {
+    void FastMultipole::precompute(int order) {
+        /** Build the interpolation and translation tables for a given order */
+        if (order < 2) throw std::runtime_error("The FMM order must be at least 2, not " + std::to_string(order));
+
+        const double PI = 3.14159265358979323846;
+        p = order;
+        const int p2 = p * p;
+
+        nodes.resize(p);
+        cheb.resize(p * p);
+        for (int m = 0; m < p; m++) {
+            nodes[m] = cos((2 * m + 1) * PI / (2 * p));
+            for (int k = 0; k < p; k++) cheb[k * p + m] = cos(k * (2 * m + 1) * PI / (2 * p));
+        }
+
+        // A child's nodes sit at -0.5 + 0.5 * node (lower half) or 0.5 + 0.5 * node
+        // (upper half) of its parent's interval
+        std::vector<double> s(p);
+        for (int side = 0; side < 2; side++) {
+            transfer[side].resize(p * p);
+            for (int m = 0; m < p; m++) {
+                interpolate((side ? 0.5 : -0.5) + 0.5 * nodes[m], s.data());
+                for (int parent = 0; parent < p; parent++)
+                    transfer[side][parent * p + m] = s[parent];
+            }
+        }
+
+        // Kernel between the nodes of a unit width cell at the origin (target)
+        // and one offset by (ox, oy) cell widths (source)
+        m2l_x.assign(49 * p2 * p2, 0);
+        m2l_y.assign(49 * p2 * p2, 0);
+        for (int ox = -3; ox <= 3; ox++) {
+            for (int oy = -3; oy <= 3; oy++) {
+                if (std::abs(ox) <= 1 && std::abs(oy) <= 1) continue; // Not well separated
+                const int offset = (ox + 3) * 7 + (oy + 3);
+
+                for (int row = 0; row < p2; row++) {
+                    double tx = 0.5 * nodes[row / p], ty = 0.5 * nodes[row % p];
+                    for (int col = 0; col < p2; col++) {
+                        double dx = tx - (ox + 0.5 * nodes[col / p]),
+                            dy = ty - (oy + 0.5 * nodes[col % p]),
+                            r2 = dx * dx + dy * dy, f = 1 / (r2 * sqrt(r2));
+                        m2l_x[(offset * p2 + row) * p2 + col] = f * dx;
+                        m2l_y[(offset * p2 + row) * p2 + col] = f * dy;
+                    }
+                }
+            }
+        }
+    }
+
+    void FastMultipole::interpolate(double u, double* s) const {
+        /** s[m] = weight of node m in the Chebyshev interpolant at u in [-1, 1] */
+        double t_prev = 1, t = u;
+        for (int m = 0; m < p; m++) s[m] = 1.0 / p + 2.0 / p * t * cheb[p + m];
+
+        for (int k = 2; k < p; k++) {
+            double t_next = 2 * u * t - t_prev;
+            t_prev = t;
+            t = t_next;
+            for (int m = 0; m < p; m++) s[m] += 2.0 / p * t * cheb[k * p + m];
+        }
+    }
+
+    void FastMultipole::evaluate(const std::vector<double>& x, const std::vector<double>& y,
+        double kuv2, int order, std::vector<double>& fx, std::vector<double>& fy) {
+        const int n = (int)x.size();
+        fx.assign(n, 0);
+        fy.assign(n, 0);
+        if (n == 0) return;
+        if (order != p) precompute(order);
+        const int p2 = p * p;
+
+        // Root cell is the bounding square of all points
+        double min_x = x[0], max_x = min_x, min_y = y[0], max_y = min_y;
+        for (int i = 0; i < n; i++) {
+            min_x = std::min(min_x, x[i]);
+            max_x = std::max(max_x, x[i]);
+            min_y = std::min(min_y, y[i]);
+            max_y = std::max(max_y, y[i]);
+        }
+
+        const double size = std::max(max_x - min_x, max_y - min_y) * (1 + 1e-9) + 1e-9;
+
+        // Subdivide until leaves hold about as much work in direct interactions
+        // as cells do in translations
+        const int leaf_size = std::max(16, 2 * p2);
+        int levels = 0;
+        while (levels < MAX_LEVEL && (n >> (2 * levels)) > leaf_size) levels++;
+        const int side = 1 << levels, leaves = side * side;
+        const double leaf_width = size / side;
+
+        // Sort bodies by leaf (counting sort), keeping coordinates contiguous
+        std::vector<int> leaf_of(n), start(leaves + 1, 0), order_of(n);
+        for (int i = 0; i < n; i++) {
+            int ix = std::min(side - 1, (int)((x[i] - min_x) / leaf_width)),
+                iy = std::min(side - 1, (int)((y[i] - min_y) / leaf_width));
+            leaf_of[i] = iy * side + ix;
+            start[leaf_of[i] + 1]++;
+        }
+
+        for (int c = 0; c < leaves; c++) start[c + 1] += start[c];
+        std::vector<int> fill(start.begin(), start.end() - 1);
+        for (int i = 0; i < n; i++) order_of[fill[leaf_of[i]]++] = i;
+
+        std::vector<double> px(n), py(n), sum_x(n, 0), sum_y(n, 0);
+        for (int k = 0; k < n; k++) {
+            px[k] = x[order_of[k]];
+            py[k] = y[order_of[k]];
+        }
+
+        // Far field: only levels 2 and below have well separated cells
+        if (levels >= 2) {
+            std::vector<std::vector<double>> weight(levels + 1), local_x(levels + 1), local_y(levels + 1);
+            for (int l = 2; l <= levels; l++) {
+                weight[l].assign((size_t)(1 << (2 * l)) * p2, 0);
+                local_x[l].assign(weight[l].size(), 0);
+                local_y[l].assign(weight[l].size(), 0);
+            }
+
+            // Bodies to leaf weights
+            #pragma omp parallel for schedule(dynamic, 64)
+            for (int c = 0; c < leaves; c++) {
+                std::vector<double> sx(p), sy(p);
+                double cx = min_x + (c % side + 0.5) * leaf_width,
+                    cy = min_y + (c / side + 0.5) * leaf_width;
+                double* w = &weight[levels][(size_t)c * p2];
+
+                for (int k = start[c]; k < start[c + 1]; k++) {
+                    interpolate((px[k] - cx) / (leaf_width / 2), sx.data());
+                    interpolate((py[k] - cy) / (leaf_width / 2), sy.data());
+                    for (int m = 0; m < p; m++)
+                        for (int mm = 0; mm < p; mm++) w[m * p + mm] += sx[m] * sy[mm];
+                }
+            }
+
+            // Children's weights to parents' weights
+            for (int l = levels - 1; l >= 2; l--) {
+                const int l_side = 1 << l;
+
+                #pragma omp parallel for
+                for (int c = 0; c < l_side * l_side; c++) {
+                    std::vector<double> tmp(p2);
+                    int ix = c % l_side, iy = c / l_side;
+                    double* w = &weight[l][(size_t)c * p2];
+
+                    for (int a = 0; a < 2; a++) {
+                        for (int b = 0; b < 2; b++) {
+                            const double* child = &weight[l + 1][
+                                ((size_t)(2 * iy + b) * (2 * l_side) + (2 * ix + a)) * p2];
+
+                            // Separable: contract y then x
+                            for (int m = 0; m < p; m++)
+                                for (int q = 0; q < p; q++) {
+                                    double sum = 0;
+                                    for (int mm = 0; mm < p; mm++) sum += transfer[b][q * p + mm] * child[m * p + mm];
+                                    tmp[m * p + q] = sum;
+                                }
+
+                            for (int q = 0; q < p; q++)
+                                for (int qq = 0; qq < p; qq++) {
+                                    double sum = 0;
+                                    for (int m = 0; m < p; m++) sum += transfer[a][q * p + m] * tmp[m * p + qq];
+                                    w[q * p + qq] += sum;
+                                }
+                        }
+                    }
+                }
+            }
+
+            // Weights to locals between well separated cells whose parents are adjacent
+            for (int l = 2; l <= levels; l++) {
+                const int l_side = 1 << l;
+                const double width = size / l_side, scale = 1 / (width * width);
+
+                #pragma omp parallel for schedule(dynamic, 16)
+                for (int c = 0; c < l_side * l_side; c++) {
+                    int ix = c % l_side, iy = c / l_side;
+                    double *lx = &local_x[l][(size_t)c * p2], *ly = &local_y[l][(size_t)c * p2];
+
+                    for (int sx = std::max(0, (ix / 2 - 1) * 2); sx < std::min(l_side, (ix / 2 + 2) * 2); sx++) {
+                        for (int sy = std::max(0, (iy / 2 - 1) * 2); sy < std::min(l_side, (iy / 2 + 2) * 2); sy++) {
+                            int ox = sx - ix, oy = sy - iy;
+                            if (std::abs(ox) <= 1 && std::abs(oy) <= 1) continue;
+
+                            const int offset = (ox + 3) * 7 + (oy + 3);
+                            const double* w = &weight[l][((size_t)sy * l_side + sx) * p2];
+                            const double* kx = &m2l_x[(size_t)offset * p2 * p2];
+                            const double* ky = &m2l_y[(size_t)offset * p2 * p2];
+
+                            for (int row = 0; row < p2; row++) {
+                                double sum_kx = 0, sum_ky = 0;
+                                for (int col = 0; col < p2; col++) {
+                                    sum_kx += kx[row * p2 + col] * w[col];
+                                    sum_ky += ky[row * p2 + col] * w[col];
+                                }
+
+                                lx[row] += scale * sum_kx;
+                                ly[row] += scale * sum_ky;
+                            }
+                        }
+                    }
+                }
+            }
+
+            // Parents' locals to children's locals
+            for (int l = 2; l < levels; l++) {
+                const int l_side = 1 << l;
+
+                #pragma omp parallel for
+                for (int c = 0; c < 4 * l_side * l_side; c++) {
+                    std::vector<double> tmp_x(p2), tmp_y(p2);
+                    int ix = c % (2 * l_side), iy = c / (2 * l_side), a = ix % 2, b = iy % 2;
+                    const size_t parent = ((size_t)(iy / 2) * l_side + ix / 2) * p2;
+                    const double *par_x = &local_x[l][parent], *par_y = &local_y[l][parent];
+                    double *lx = &local_x[l + 1][(size_t)c * p2], *ly = &local_y[l + 1][(size_t)c * p2];
+
+                    // Transpose of the weight translation, again contracting y then x
+                    for (int q = 0; q < p; q++)
+                        for (int mm = 0; mm < p; mm++) {
+                            double dot_x = 0, dot_y = 0;
+                            for (int qq = 0; qq < p; qq++) {
+                                dot_x += transfer[b][qq * p + mm] * par_x[q * p + qq];
+                                dot_y += transfer[b][qq * p + mm] * par_y[q * p + qq];
+                            }
+                            tmp_x[q * p + mm] = dot_x;
+                            tmp_y[q * p + mm] = dot_y;
+                        }
+
+                    for (int m = 0; m < p; m++)
+                        for (int mm = 0; mm < p; mm++) {
+                            double dot_x = 0, dot_y = 0;
+                            for (int q = 0; q < p; q++) {
+                                dot_x += transfer[a][q * p + m] * tmp_x[q * p + mm];
+                                dot_y += transfer[a][q * p + m] * tmp_y[q * p + mm];
+                            }
+                            lx[m * p + mm] += dot_x;
+                            ly[m * p + mm] += dot_y;
+                        }
+                }
+            }
+
+            // Leaf locals to bodies
+            #pragma omp parallel for schedule(dynamic, 64)
+            for (int c = 0; c < leaves; c++) {
+                std::vector<double> sx(p), sy(p);
+                double cx = min_x + (c % side + 0.5) * leaf_width,
+                    cy = min_y + (c / side + 0.5) * leaf_width;
+                const double *lx = &local_x[levels][(size_t)c * p2], *ly = &local_y[levels][(size_t)c * p2];
+
+                for (int k = start[c]; k < start[c + 1]; k++) {
+                    interpolate((px[k] - cx) / (leaf_width / 2), sx.data());
+                    interpolate((py[k] - cy) / (leaf_width / 2), sy.data());
+                    for (int m = 0; m < p; m++)
+                        for (int mm = 0; mm < p; mm++) {
+                            sum_x[k] += sx[m] * sy[mm] * lx[m * p + mm];
+                            sum_y[k] += sx[m] * sy[mm] * ly[m * p + mm];
+                        }
+                }
+            }
+        }
+
+        // Near field: direct sums between adjacent leaves
+        #pragma omp parallel for schedule(dynamic, 64)
+        for (int c = 0; c < leaves; c++) {
+            int ix = c % side, iy = c / side;
+            for (int sx = std::max(0, ix - 1); sx <= std::min(side - 1, ix + 1); sx++) {
+                for (int sy = std::max(0, iy - 1); sy <= std::min(side - 1, iy + 1); sy++) {
+                    const int source = sy * side + sx;
+                    for (int k = start[c]; k < start[c + 1]; k++) {
+                        for (int j = start[source]; j < start[source + 1]; j++) {
+                            if (j == k) continue;
+                            double dx = px[k] - px[j], dy = py[k] - py[j],
+                                r2 = dx * dx + dy * dy, f = 1 / (r2 * sqrt(r2));
+                            sum_x[k] += f * dx;
+                            sum_y[k] += f * dy;
+                        }
+                    }
+                }
+            }
+        }
+
+        for (int k = 0; k < n; k++) {
+            fx[order_of[k]] = kuv2 * sum_x[k];
+            fy[order_of[k]] = kuv2 * sum_y[k];
+        }
+    }
+}
@@ -0,0 +1,35 @@
+// Fast multipole method for the electrical force in Eades' algorithm
+
+#pragma once
+#include <vector>
+
+namespace force_directed {
+    class FastMultipole {
+        /** Black-box fast multipole method (Fong and Darve 2009) on a uniform
+         *  quadtree. Every cell summarizes its bodies by weights on an
+         *  order x order grid of Chebyshev nodes, and well separated cells
+         *  interact only through those nodes. The error falls off
+         *  geometrically with the order, and the cost is O(n) for a fixed order.
+         */
+    public:
+        FastMultipole() = default;
+
+        /** Set fx[i], fy[i] to the sum over j != i of kuv2 * (p_i - p_j) / |p_i - p_j|^3 */
+        void evaluate(const std::vector<double>& x, const std::vector<double>& y,
+            double kuv2, int order, std::vector<double>& fx, std::vector<double>& fy);
+
+    private:
+        // Tables below depend only on the order, so they are kept between calls
+        int p = 0;
+        std::vector<double> nodes;        // Chebyshev nodes on [-1, 1]
+        std::vector<double> cheb;         // cheb[k * p + m] = T_k(nodes[m])
+        std::vector<double> transfer[2];  // [side][m' * p + m]: weight of a child's node m in its parent's node m'
+        std::vector<double> m2l_x, m2l_y; // Kernel between nodes of unit cells, for each of 7 x 7 offsets
+
+        // Finest level never goes past this (4^10 leaves)
+        static const int MAX_LEVEL = 10;
+
+        void precompute(int order);
+        void interpolate(double u, double* s) const;
+    };
+}
@@ -1,15 +1,25 @@
 #pragma once
 #define NOMINMAX // Thanks Windows.h
 #include "../lib/Eigen/Dense"
+#include "../lib/Eigen/Sparse"
 #include "Snap.h"
 #include "svg.hpp"
+#include "quadtree.h"
+#include "fmm.h"
+#include "grid.h"
+#include "simd_repulsion.h"
+#include "raster.h"
 #include <math.h>
+#include <stdint.h>
 #include <random>
 #include <vector>
 #include <map>
 #include <set>
 #include <fstream>
 #include <set>
+#include <unordered_map>
+#include <functional>
+#include <algorithm>
 
 namespace force_directed {
     using AdjacencyList = std::map<int, std::set<int>>;
@@ -18,40 +28,427 @@ namespace force_directed {
     using Eigen::MatrixXd;
     using Eigen::VectorXd;
 
+    enum class Repulsion {
+        EXACT,      /** Sum the electrical force over all pairs of vertices */
+        BARNES_HUT, /** Approximate far away vertices with a quadtree */
+        FMM,        /** Fast multipole method */
+        GRID        /** Only vertices closer than a cutoff, found with a uniform grid */
+    };
+
     struct ForceDirectedParams {
         double luv;
         double kuv1;
         double kuv2;
+        Repulsion repulsion = Repulsion::EXACT;
+        double theta = 0.5; /** Barnes-Hut opening angle */
+        int fmm_order = 4;  /** Chebyshev nodes per cell side for the FMM */
+        double cutoff = 2;  /** Grid cutoff radius as a multiple of luv */
+
+        // Integrator
+        double pct = 0.1;          /** Each vertex moves by pct times its force... */
+        double cooling = 0.9;      /** ...capped by a temperature scaled by this factor */
+        double tolerance = 1e-3;   /** Stop once the mean move is below tolerance * luv */
+        int max_iterations = 1000; /** Iteration cap for eades84_2 */
+    };
+
+    struct Cooling {
+        /** Adaptive step length of the spring layouts (Hu 2005). No vertex moves
+         *  further than the temperature in one iteration. The temperature
+         *  rises after every five iterations in a row that lower the energy
+         *  (sum of squared forces), and falls after any that don't.
+         */
+        double temperature;
+        double energy = INFINITY;
+        int progress = 0;
+
+        explicit Cooling(double temperature) : temperature(temperature) {}
+        void update(double energy, double factor);
+    };
+
+    struct ForceWorkspace {
+        /** Scratch space reused between iterations by the approximate
+         *  electrical force methods
+         */
+        QuadTree tree;
+        FastMultipole fmm;
+        SpatialGrid grid;
+    };
+
+    struct LayoutState {
+        /** Vertex positions and forces stored in flat arrays indexed by a
+         *  dense index 0 ... n - 1, assigned in graph iteration order
+         */
+        std::vector<int> ids;               // Dense index -> SNAP id
+        std::unordered_map<int, int> index; // SNAP id -> dense index
+        std::vector<double> x, y, fx, fy;
+
+        LayoutState() = default;
+        explicit LayoutState(int n);
+        LayoutState(TUNGraph& graph);
+        LayoutState(TUNGraph& graph, VertexPos& pos);
+        int size() const { return (int)ids.size(); }
+        void store(VertexPos& pos) const;
+        VertexPos to_pos() const;
+    };
+
+    struct CSRAdjacency {
+        /** Compressed sparse row adjacency over dense vertex indices: the
+         *  neighbors of u are neighbors[offsets[u]] ... neighbors[offsets[u + 1] - 1],
+         *  sorted in increasing order
+         */
+        std::vector<int> offsets;
+        std::vector<int> neighbors;
+
+        CSRAdjacency() = default;
+        CSRAdjacency(TUNGraph& graph, const LayoutState& state);
+        int size() const { return (int)offsets.size() - 1; }
+        int degree(int u) const { return offsets[u + 1] - offsets[u]; }
+        const int* begin(int u) const { return neighbors.data() + offsets[u]; }
+        const int* end(int u) const { return neighbors.data() + offsets[u + 1]; }
+        bool adjacent(int u, int v) const;
+    };
+
+    /** Receives a layout engine's positions after an iteration (0 = initial positions) */
+    using FrameCallback = std::function<void(const LayoutState& state, int iteration)>;
+
+    struct FrameOptions {
+        int stride = 1;          /** Pass on every stride-th iteration */
+        bool final_only = false; /** Only pass on the final positions */
+    };
+
+    class FrameRecorder {
+        /** Helper for layout engines which decides which iterations reach the callback */
+    public:
+        FrameRecorder(const FrameCallback& callback, const FrameOptions& options);
+        void record(const LayoutState& state, int iteration);
+        void finish(const LayoutState& state, int iteration);
+
+    private:
+        const FrameCallback& callback;
+        const FrameOptions& options;
+        int last = -1; // Last iteration passed on
+    };
+
+    struct StressParams {
+        double edge_length = 100; /** Target distance between adjacent vertices */
+        int hops = 3;             /** Exact distances to every vertex within this many hops... */
+        int pivots = 50;          /** ...and distances to this many pivots standing in for the rest */
+        double tolerance = 1e-4;  /** Stop once stress falls by less than this fraction */
+        int max_iterations = 100;
+        unsigned seed = 0;        /** Picks the first pivot */
+    };
+
+    class BarycenterSolver {
+        /** Factorization of the barycenter system for one graph and set of
+         *  fixed vertices (the first fixed_vertices in graph order), reusable
+         *  for any positions of the fixed vertices. Each layout then costs
+         *  two sparse triangular solves.
+         */
+    public:
+        BarycenterSolver(TUNGraph& graph, const size_t fixed_vertices);
+        int fixed_count() const { return n_fixed; }
+        int free_count() const { return state.size() - n_fixed; }
+        int id(int vertex) const { return state.ids[vertex]; } /** Fixed vertices first, then free */
+        const Eigen::SparseMatrix<double>& matrix() const { return a; }
+        const Eigen::SparseMatrix<double>& coupling() const { return b; }
+
+        /** Each column of fixed_x, fixed_y (fixed_count() rows) is one placement of the
+         *  fixed vertices; the same column of free_x, free_y (free_count() rows) is
+         *  set to where it puts the free vertices
+         */
+        void solve(const MatrixXd& fixed_x, const MatrixXd& fixed_y,
+            MatrixXd& free_x, MatrixXd& free_y) const;
+        VertexPos layout(const std::vector<Point>& fixed_pos) const;
+
+    private:
+        LayoutState state;
+        int n_fixed;
+        Eigen::SparseMatrix<double> a; // Free x free: degrees minus adjacency
+        Eigen::SparseMatrix<double> b; // Free x fixed: 1 where adjacent
+        Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>> ldlt;
+    };
+
+    enum class Relaxation {
+        JACOBI,   /** Every free vertex moves to its neighbors' barycenter at once */
+        SOR,      /** Successive over-relaxation, one color class at a time */
+        MULTIGRID /** Conjugate gradients preconditioned by an algebraic multigrid V-cycle */
+    };
+
+    struct BarycenterParams {
+        Relaxation method = Relaxation::SOR;
+        double omega = 1.8;         /** SOR over-relaxation factor (1 = Gauss-Seidel, must be below 2) */
+        double tolerance = 1e-8;    /** Stop once the residual norm is below tolerance times its initial value */
+        int max_iterations = 100000; /** Sweeps, or conjugate gradient steps for MULTIGRID */
+    };
+
+    struct SpectralParams {
+        double edge_length = 100; /** Mean length of an edge in the layout */
+        double tolerance = 1e-4;  /** Stop refining a level once the eigenvector residuals are below this */
+        int max_iterations = 200; /** Iteration cap per level */
+        unsigned seed = 0;
+    };
+
+    struct IncrementalParams {
+        int hops = 2;              /** Relax every vertex within this many hops of an edit... */
+        int local_iterations = 50; /** ...for at most this many iterations, with the rest held still */
+        int polish_iterations = 0; /** Then run this many iterations of eades84_2 on the whole graph */
+    };
+
+    class IncrementalLayout {
+        /** A spring layout kept up to date as vertices and edges are added
+         *  and removed. Edits are queued up and applied to the graph at
+         *  once; update() then places new vertices at the barycenter of
+         *  their neighbors and relaxes only the neighborhood of the edits,
+         *  starting from the previous positions. The electrical force in
+         *  local relaxation is always the grid cutoff approximation.
+         */
+    public:
+        IncrementalLayout(const ForceDirectedParams& params, TUNGraph& graph, VertexPos& pos);
+        void add_node(int id);
+        void add_edge(int u, int v); /** Adds u and v if they are missing */
+        void remove_node(int id);
+        void remove_edge(int u, int v);
+
+        /** Returns the number of vertices relaxed */
+        int update(const IncrementalParams& options = IncrementalParams());
+        TUNGraph& graph() { return g; }
+        const LayoutState& state() const { return current; }
+        VertexPos positions() const { return current.to_pos(); }
+
+    private:
+        ForceDirectedParams params;
+        TUNGraph g;
+        LayoutState current;
+        std::vector<char> placed;   // Whether each vertex (by dense index) has a position yet
+        std::set<int> touched;      // SNAP ids of vertices next to an edit since the last update
+        std::mt19937 generator;
+        ForceWorkspace workspace;
+
+        void append(int id);
+        void erase(int u);
+        void place();
+        int relax(const std::vector<int>& active, int iterations);
     };
 
     struct BarycenterLayout {
         /** Return value of linear algebra based solver */
         SVG::SVG image;
-        MatrixXd matrix;
+        Eigen::SparseMatrix<double> matrix;
         VectorXd fixed_x;
         VectorXd fixed_y;
         VectorXd sol_x;
         VectorXd sol_y;
+        VertexPos pos; /** Every vertex, fixed and free */
     };
 
     std::pair<double, double> get_xy(TUNGraph& graph, int id);
     std::pair<double, double> get_xy(TUNGraph::TNodeI node);
     SVG::SVG draw_graph(TUNGraph& graph, VertexPos& pos, const double width = 500);
+    SVG::SVG draw_graph(TUNGraph& graph, const LayoutState& state, const double width = 500);
+    /** Radius of the circles in a drawing width wide */
+    inline double vertex_radius(const double width) { return std::max(5.0, width / 50); }
+
+    struct ViewBox {
+        /** The region a drawing shows: the bounding box of the vertex
+         *  centers added to it, grown by the circle radius and a margin
+         */
+        double radius;
+        double min_x = 0, min_y = 0, max_x = 0, max_y = 0; // Of the vertex centers
+        bool empty = true;
+
+        explicit ViewBox(const double width = 500) : radius(vertex_radius(width)) {}
+        ViewBox(const LayoutState& state, const double width = 500);
+        void add(double x, double y);
+        double left() const { return min_x - radius - MARGIN; }
+        double top() const { return min_y - radius - MARGIN; }
+        double right() const { return max_x + radius + MARGIN; }
+        double bottom() const { return max_y + radius + MARGIN; }
+
+        static constexpr double MARGIN = 10;
+    };
+
+    void write_svg(std::ostream& out, TUNGraph& graph, const LayoutState& state, const double width = 500);
+    Raster rasterize(TUNGraph& graph, const LayoutState& state, const ViewBox& box, const int pixels = 1000);
+    Raster rasterize(TUNGraph& graph, const LayoutState& state, const int pixels = 1000, const double width = 500);
+
+    class SMILAnimation {
+        /** An animated drawing in a single SVG document: each circle and line
+         *  appears once, and SMIL <animate> elements move it through the
+         *  frames. A run of frames in which a vertex moves by at most
+         *  tolerance is kept as just its first and last keyframes.
+         */
+    public:
+        SMILAnimation(TUNGraph& graph, const double width = 500, const double tolerance = 0.1);
+        void add_frame(const LayoutState& state);
+        void write(std::ostream& out, const double fps) const;
+        int frames() const { return n_frames; }
+
+        /** Set the positions in state (made from the same graph) to those the
+         *  animation shows at a frame, within tolerance of the ones added */
+        void positions(int frame, LayoutState& state) const;
+        ViewBox view_box() const; /** Holds every frame */
+
+    private:
+        struct Keyframe {
+            int frame;
+            double x, y;
+        };
+
+        std::vector<std::pair<int, int>> edges;
+        std::vector<std::vector<Keyframe>> keyframes; // For each vertex
+        std::vector<Keyframe> pending;                // Latest frame of each vertex, if not kept
+        double tolerance;
+        ViewBox box;                                  // Around the kept keyframes
+        int n_frames = 0;
+    };
+
+    struct TileParams {
+        int levels = 6;      /** Zoom levels 0 to levels - 1, where level z is 2^z tiles across */
+        int tile_size = 256; /** Width and height of a tile in pixels */
+        double radius = 2;   /** Vertex radius in pixels */
+        int min_length = 1;  /** Edges shorter than this many pixels are left out of a level */
+    };
+
+    class TileIndex {
+        /** A spatial index for cutting a drawing into a pyramid of square
+         *  tiles: a grid as fine as the tiles of the deepest level listing
+         *  the vertices in each cell, and for each level the edges crossing
+         *  each of its tiles. At each level vertices and edge ends are
+         *  snapped to pixels and merged, so a coarse tile holds at most
+         *  about one circle per pixel, and edges shorter than min_length
+         *  pixels are left out of that level's lists.
+         */
+    public:
+        TileIndex(TUNGraph& graph, const LayoutState& state, const TileParams& params = TileParams());
+
+        /** The SVG for tile (x, y) of a level, with y = 0 at the top, or an
+         *  empty string if nothing is drawn on it */
+        std::string tile(int level, int x, int y) const;
+        const TileParams& parameters() const { return params; }
+
+    private:
+        TileParams params;
+        int grid;                           // Cells across, 2^(levels - 1)
+        double min_x, min_y, side;          // Square the drawing is cut from
+        std::vector<double> x, y;
+        std::vector<std::pair<int, int>> edges;
+        std::vector<int> vertex_start, vertex_cells; // CSR of cell -> vertices
+        std::vector<std::vector<long long>> edge_start; // For each level, CSR of tile -> edges crossing it
+        std::vector<std::vector<int>> edge_tiles;
+
+        long long snap(double value, double origin, int level) const;
+        bool drawn(int e, int level) const;
+
+        template<typename Visit>
+        void tiles_crossed(int e, int level, Visit visit) const;
+    };
+
+    long long write_tiles(const std::string& directory, TUNGraph& graph, const LayoutState& state,
+        const TileParams& params = TileParams());
     
+    void set_threads(int threads);
     VertexPos random_layout(TUNGraph&);
+    VertexPos random_layout(TUNGraph&, unsigned seed);
+    VertexPos pivot_mds_layout(TUNGraph& graph, const double edge_length = 100,
+        const int pivots = 50, unsigned seed = 0);
     std::vector<SVG::SVG> eades84(TUNGraph& graph);
     std::vector<SVG::SVG> eades84(TUNGraph& graph, VertexPos& pos);
+    void eades84(TUNGraph& graph, VertexPos& pos,
+        const FrameCallback& callback, const FrameOptions& options = FrameOptions());
     std::vector<SVG::SVG> eades84_2(ForceDirectedParams& params, TUNGraph& graph);
     std::vector<SVG::SVG> eades84_2(ForceDirectedParams& params, TUNGraph& graph, VertexPos& pos);
+    void eades84_2(ForceDirectedParams& params, TUNGraph& graph, VertexPos& pos,
+        const FrameCallback& callback, const FrameOptions& options = FrameOptions());
 
     namespace eades84_helper {
-        double distance_between(VertexPos& pos, int node1, int node2);
-        Point calculate_force(ForceDirectedParams& params, TUNGraph& graph, int node,
-            AdjacencyList& adjacent, VertexPos& pos);
+        double distance_between(const LayoutState& state, int node1, int node2);
+        Point spring_force(ForceDirectedParams& params, int node,
+            const CSRAdjacency& adjacent, const LayoutState& state);
+        Point calculate_force(ForceDirectedParams& params, int node,
+            const CSRAdjacency& adjacent, const LayoutState& state);
+        Point calculate_force(ForceDirectedParams& params, int node,
+            const CSRAdjacency& adjacent, const LayoutState& state, const QuadTree& tree);
+        void calculate_forces(ForceDirectedParams& params, const CSRAdjacency& adjacent,
+            LayoutState& state, ForceWorkspace& workspace);
+        bool step(ForceDirectedParams& params, const CSRAdjacency& adjacent,
+            LayoutState& state, ForceWorkspace& workspace, Cooling& cooling);
+    }
+
+    std::vector<SVG::SVG> eades84_multilevel(ForceDirectedParams& params, TUNGraph& graph, VertexPos& pos);
+    void eades84_multilevel(ForceDirectedParams& params, TUNGraph& graph, VertexPos& pos,
+        const FrameCallback& callback, const FrameOptions& options = FrameOptions(),
+        const int level_iterations = 50);
+
+    namespace multilevel_helper {
+        CSRAdjacency coarsen(const CSRAdjacency& fine, std::vector<int>& parent, std::mt19937& generator);
     }
     
+    std::vector<SVG::SVG> stress_layout(StressParams& params, TUNGraph& graph, VertexPos& pos);
+    void stress_layout(StressParams& params, TUNGraph& graph, VertexPos& pos,
+        const FrameCallback& callback, const FrameOptions& options = FrameOptions());
+
+    namespace stress_helper {
+        struct Term {
+            int i, j;
+            double d; // Target distance
+            double w; // Weight
+        };
+
+        void bfs(const CSRAdjacency& adjacent, int source, std::vector<int>& dist);
+        std::vector<int> maxmin_pivots(const CSRAdjacency& adjacent, int k, unsigned seed,
+            std::vector<std::vector<int>>& dist);
+        std::vector<Term> sparse_terms(StressParams& params, const CSRAdjacency& adjacent);
+        double stress(const std::vector<Term>& terms, const LayoutState& state);
+    }
+
+    VertexPos spectral_layout(SpectralParams& params, TUNGraph& graph);
+
+    namespace spectral_helper {
+        const int BLOCK = 4; // Vectors iterated together: the two coordinates plus two guards
+
+        using Laplacian = Eigen::SparseMatrix<double, Eigen::RowMajor>;
+        using Block = Eigen::Matrix<double, Eigen::Dynamic, BLOCK, Eigen::RowMajor>;
+
+        Laplacian laplacian(const CSRAdjacency& adjacent);
+        int eigenvectors(const Laplacian& laplacian, Block& x, double tolerance,
+            int max_iterations, std::mt19937& generator);
+    }
+
+    namespace barycenter_helper {
+        using SparseMatrix = Eigen::SparseMatrix<double>;
+
+        void system(const CSRAdjacency& adjacent, int n_fixed, SparseMatrix& free, SparseMatrix& coupling);
+        std::vector<std::vector<int>> color_classes(const CSRAdjacency& adjacent, int n_fixed);
+        double residual(const CSRAdjacency& adjacent, int n_fixed, const LayoutState& state);
+
+        class Multigrid {
+            /** Smoothed aggregation AMG (Vanek, Mandel and Brezina 1996) for
+             *  the free x free barycenter matrix
+             */
+        public:
+            explicit Multigrid(const SparseMatrix& a);
+            int levels() const { return (int)a.size(); }
+            void cycle(const MatrixXd& b, MatrixXd& x) const { cycle(0, b, x); }
+
+        private:
+            std::vector<SparseMatrix> a, p; // p[l] interpolates level l + 1 to level l
+            std::vector<VectorXd> weight;   // Damped Jacobi smoother weights: omega / a_ii
+            Eigen::SimplicialLDLT<SparseMatrix> coarsest;
+
+            // Solve directly at or below this size
+            static const int COARSEST = 200;
+
+            void cycle(int level, const MatrixXd& b, MatrixXd& x) const;
+            void smooth(int level, const MatrixXd& b, MatrixXd& x) const;
+        };
+    }
+
     std::vector<SVG::SVG> barycenter_layout(TUNGraph& graph,
         const size_t fixed_vertices = 5, const double width = 500);
+    void barycenter_layout(TUNGraph& graph, const size_t fixed_vertices, const double width,
+        const FrameCallback& callback, const FrameOptions& options = FrameOptions());
+    void barycenter_layout(TUNGraph& graph, const size_t fixed_vertices, const double width,
+        BarycenterParams& params, const FrameCallback& callback, const FrameOptions& options = FrameOptions());
     BarycenterLayout barycenter_layout_la(TUNGraph& graph,
         const size_t fixed_vertices, const double width = 500);
 
@@ -60,10 +457,82 @@ namespace force_directed {
     using VertexSet = std::set<int>;
 
     AdjacencyList adjacency_list(TUNGraph& graph);
+    void scale_edge_length(LayoutState& state, const CSRAdjacency& adjacent, double edge_length);
     EdgeSet incident_edges(int id, const TUNGraph& graph);
     VertexSet adjacent_vertices(int id, const TUNGraph& graph);
     std::map<int, VertexSet> adjacency_list(const TUNGraph& graph);
 
+    // Graph and layout files
+    struct EdgeListHeader {
+        /** Start of a binary edge list file, which continues with edges pairs
+         *  of vertex ids, each width bytes wide. Everything is little-endian:
+         *  the header and ids are written and read in place as they are in
+         *  memory, so edge lists can only be used on little-endian machines.
+         */
+        char magic[8];    // "FDEDGES" and a null
+        uint32_t version; // 1
+        uint32_t width;   // 4 (int32) or 8 (int64)
+        uint64_t edges;
+    };
+
+    class EdgeListWriter {
+        /** Writes a binary edge list one edge at a time. The header is only
+         *  written by close(), so a writer destroyed without it (e.g. after
+         *  an error) leaves a file that is_edge_list() rejects.
+         */
+    public:
+        EdgeListWriter(const std::string& file, int width = 4);
+        ~EdgeListWriter();
+        void add(long long u, long long v);
+        void close();
+        uint64_t size() const { return edges; }
+
+    private:
+        std::ofstream out;
+        std::string file;
+        int width;
+        uint64_t edges = 0;
+    };
+
+    bool is_edge_list(const std::string& file);
+    void read_edge_list(const std::string& file, TUNGraph& graph);
+    void graph_from_edges(const std::vector<int>& endpoints, TUNGraph& graph);
+    void read_edge_csv(const std::string& file, TUNGraph& graph);
+
+    /** Receives the endpoint pairs of one chunk of an edge file */
+    using EdgeChunkCallback = std::function<void(const std::vector<long long>& endpoints)>;
+    void read_edge_csv(const std::string& file, const EdgeChunkCallback& callback);
+    void read_positions_csv(const std::string& file, VertexPos& pos);
+
+    struct SnapshotHeader {
+        /** Start of a binary layout snapshot, which continues with the vertices'
+         *  int32 ids in dense order, padded to a multiple of 8 bytes, then all
+         *  of their x coordinates and then all of their y coordinates, as
+         *  floats width bytes wide. Everything is little-endian, written and
+         *  read in place as it is in memory, so snapshots can only be used on
+         *  little-endian machines.
+         */
+        char magic[8];       // "FDSNAP" and nulls
+        uint32_t version;    // 1
+        uint32_t width;      // 4 (float32) or 8 (float64)
+        uint64_t vertices;
+        uint64_t graph_hash; // graph_hash() of the graph that was laid out
+        int64_t iteration;   // Iterations the layout engine had run
+    };
+
+    uint64_t graph_hash(TUNGraph& graph);
+    void write_snapshot(const std::string& file, TUNGraph& graph, const LayoutState& state,
+        long long iteration, int width = 8);
+    bool is_snapshot(const std::string& file);
+    SnapshotHeader read_snapshot(const std::string& file, VertexPos& pos);
+
+    namespace csv_helper {
+        bool next_field(const char*& p, const char* end, const char*& begin, const char*& finish);
+        bool parse_int(const char* begin, const char* end, long long& value);
+        bool parse_double(const char* begin, const char* end, double& value);
+        std::vector<std::pair<size_t, size_t>> chunks(const char* data, size_t size, size_t start);
+    }
+
     // Functions for creating graphs
     TUNGraph cycle(int nodes);
     TUNGraph complete_bipartite(int m, int n);
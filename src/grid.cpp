@@ -0,0 +1,80 @@
+#include "grid.h"
+#include <algorithm>
+#include <math.h>
+
+namespace force_directed {
+    void SpatialGrid::build(const std::vector<double>& x, const std::vector<double>& y, double cutoff) {
+        /** Rebuild the grid from scratch with a counting sort of the bodies
+         *  by cell. The grid keeps pointers to x and y, so they must outlive
+         *  any calls to repulsion().
+         */
+        const int n = (int)x.size();
+        this->x = &x;
+        this->y = &y;
+        this->cutoff2 = cutoff > 0 ? cutoff * cutoff : 0;
+        this->cols = this->rows = 0;
+        this->start.clear();
+        this->order.resize(n);
+        this->cell.resize(n);
+        if (n == 0) return;
+
+        double max_x = x[0], max_y = y[0];
+        min_x = x[0];
+        min_y = y[0];
+        for (int i = 0; i < n; i++) {
+            min_x = std::min(min_x, x[i]);
+            max_x = std::max(max_x, x[i]);
+            min_y = std::min(min_y, y[i]);
+            max_y = std::max(max_y, y[i]);
+        }
+
+        // Cells narrower than the cutoff would miss bodies in the 3 x 3 block,
+        // while wider cells are only slower, so widen them if the layout is
+        // too spread out to cover with a reasonable number of cells
+        const double span_x = max_x - min_x, span_y = max_y - min_y,
+            max_cells = (double)CELLS_PER_BODY * n + 16;
+        width = std::max(cutoff, 1e-9);
+        while ((span_x / width + 1) * (span_y / width + 1) > max_cells) width *= 2;
+
+        cols = (int)(span_x / width) + 1;
+        rows = (int)(span_y / width) + 1;
+
+        // Counting sort by cell
+        start.assign((size_t)cols * rows + 1, 0);
+        for (int i = 0; i < n; i++) {
+            int cx = std::min(cols - 1, (int)((x[i] - min_x) / width)),
+                cy = std::min(rows - 1, (int)((y[i] - min_y) / width));
+            cell[i] = cy * cols + cx;
+            start[cell[i] + 1]++;
+        }
+
+        for (size_t c = 1; c < start.size(); c++) start[c] += start[c - 1];
+
+        std::vector<int> fill(start.begin(), start.end() - 1);
+        for (int i = 0; i < n; i++) order[fill[cell[i]]++] = i;
+    }
+
+    SpatialGrid::Point SpatialGrid::repulsion(int i, double px, double py, double kuv2) const {
+        double sum_x = 0, sum_y = 0;
+        if (cols == 0) return std::make_pair(sum_x, sum_y);
+
+        const int cx = cell[i] % cols, cy = cell[i] / cols;
+        for (int ny = std::max(0, cy - 1); ny <= std::min(rows - 1, cy + 1); ny++) {
+            for (int nx = std::max(0, cx - 1); nx <= std::min(cols - 1, cx + 1); nx++) {
+                const int c = ny * cols + nx;
+                for (int k = start[c]; k < start[c + 1]; k++) {
+                    const int b = order[k];
+                    double dx = px - (*x)[b], dy = py - (*y)[b],
+                        dist2 = dx * dx + dy * dy;
+                    if (b == i || dist2 >= cutoff2) continue;
+
+                    double dist = sqrt(dist2);
+                    sum_x += (kuv2 / dist2) * dx / dist;
+                    sum_y += (kuv2 / dist2) * dy / dist;
+                }
+            }
+        }
+
+        return std::make_pair(sum_x, sum_y);
+    }
+}
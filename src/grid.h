@@ -0,0 +1,40 @@
+// Uniform grid for a short-range electrical force in Eades' algorithm
+
+#pragma once
+#include <vector>
+#include <utility>
+
+namespace force_directed {
+    class SpatialGrid {
+        /** Buckets bodies into square cells at least as wide as the cutoff
+         *  radius, so every body within the cutoff of a point lies in the
+         *  3 x 3 block of cells around it (Fruchterman and Reingold 1991)
+         */
+    public:
+        using Point = std::pair<double, double>;
+
+        SpatialGrid() = default;
+
+        /** Build over bodies 0, 1, ..., x.size() - 1 */
+        void build(const std::vector<double>& x, const std::vector<double>& y, double cutoff);
+
+        /** Sum of kuv2 / d^2 * (p - q) / d over every body q except body i
+         *  with d < cutoff (the cutoff passed to build())
+         */
+        Point repulsion(int i, double px, double py, double kuv2) const;
+
+    private:
+        double min_x = 0, min_y = 0;
+        double width = 1;       // Width of a cell
+        double cutoff2 = 0;     // Square of the cutoff radius
+        int cols = 0, rows = 0;
+        std::vector<int> start; // Bodies in cell c are order[start[c]] ... order[start[c + 1] - 1]
+        std::vector<int> order;
+        std::vector<int> cell;  // Cell of each body
+        const std::vector<double>* x = nullptr;
+        const std::vector<double>* y = nullptr;
+
+        // Never allocate more than this many cells per body
+        static const int CELLS_PER_BODY = 4;
+    };
+}
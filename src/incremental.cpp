@@ -0,0 +1,303 @@
+#include "force_directed.h"
+#include <algorithm>
+
+namespace force_directed {
+    IncrementalLayout::IncrementalLayout(const ForceDirectedParams& params, TUNGraph& graph, VertexPos& pos) :
+        params(params), g(graph), current(g, pos), generator(0) {
+        /** Start from a copy of graph laid out at pos. Vertices missing from
+         *  pos are placed by the first update().
+         */
+        placed.resize(current.size());
+        for (int u = 0; u < current.size(); u++) {
+            placed[u] = pos.count(current.ids[u]) > 0;
+            if (!placed[u]) touched.insert(current.ids[u]);
+        }
+    }
+
+    void IncrementalLayout::add_node(int id) {
+        if (g.IsNode(id)) return;
+        g.AddNode(id);
+        append(id);
+        touched.insert(id);
+    }
+
+    void IncrementalLayout::add_edge(int u, int v) {
+        add_node(u);
+        add_node(v);
+        if (!g.IsEdge(u, v)) g.AddEdge(u, v);
+        touched.insert(u);
+        touched.insert(v);
+    }
+
+    void IncrementalLayout::remove_node(int id) {
+        if (!g.IsNode(id)) return;
+
+        // Its neighbors lose an edge
+        auto node = g.GetNI(id);
+        for (int k = 0; k < node.GetDeg(); k++) touched.insert(node.GetNbrNId(k));
+        touched.erase(id);
+
+        erase(current.index.at(id));
+        g.DelNode(id);
+    }
+
+    void IncrementalLayout::remove_edge(int u, int v) {
+        if (!g.IsNode(u) || !g.IsNode(v) || !g.IsEdge(u, v)) return;
+        g.DelEdge(u, v);
+        touched.insert(u);
+        touched.insert(v);
+    }
+
+    void IncrementalLayout::append(int id) {
+        current.index[id] = current.size();
+        current.ids.push_back(id);
+        current.x.push_back(0);
+        current.y.push_back(0);
+        current.fx.push_back(0);
+        current.fy.push_back(0);
+        placed.push_back(false);
+    }
+
+    void IncrementalLayout::erase(int u) {
+        /** Remove the vertex with dense index u, moving the last vertex into
+         *  its place so the other indices stay put
+         */
+        const int last = current.size() - 1;
+        current.index.erase(current.ids[u]);
+
+        if (u != last) {
+            current.ids[u] = current.ids[last];
+            current.index[current.ids[u]] = u;
+            current.x[u] = current.x[last];
+            current.y[u] = current.y[last];
+            current.fx[u] = current.fx[last];
+            current.fy[u] = current.fy[last];
+            placed[u] = placed[last];
+        }
+
+        current.ids.pop_back();
+        current.x.pop_back();
+        current.y.pop_back();
+        current.fx.pop_back();
+        current.fy.pop_back();
+        placed.pop_back();
+    }
+
+    void IncrementalLayout::place() {
+        /** Put each new vertex at the barycenter of its placed neighbors, plus
+         *  a small random offset so that vertices with the same neighbors
+         *  don't coincide. New vertices whose neighbors are all new wait for
+         *  them, and any left over (e.g. a new component) go somewhere random
+         *  inside the current drawing.
+         */
+        std::vector<int> pending;
+        double min_x = INFINITY, max_x = -INFINITY, min_y = INFINITY, max_y = -INFINITY;
+        for (int u = 0; u < current.size(); u++) {
+            if (!placed[u]) {
+                pending.push_back(u);
+                continue;
+            }
+
+            min_x = std::min(min_x, current.x[u]);
+            max_x = std::max(max_x, current.x[u]);
+            min_y = std::min(min_y, current.y[u]);
+            max_y = std::max(max_y, current.y[u]);
+        }
+
+        if (pending.empty()) return;
+        if (min_x > max_x) min_x = max_x = min_y = max_y = 0; // Nothing placed yet
+
+        const double offset = 0.1 * params.luv;
+        std::uniform_real_distribution<double> jitter(-offset, offset);
+
+        while (!pending.empty()) {
+            std::vector<int> waiting;
+            for (int u : pending) {
+                double sum_x = 0, sum_y = 0;
+                int count = 0;
+
+                auto node = g.GetNI(current.ids[u]);
+                for (int k = 0; k < node.GetDeg(); k++) {
+                    int v = current.index.at(node.GetNbrNId(k));
+                    if (!placed[v] || v == u) continue;
+                    sum_x += current.x[v];
+                    sum_y += current.y[v];
+                    count++;
+                }
+
+                if (count == 0) {
+                    waiting.push_back(u);
+                    continue;
+                }
+
+                current.x[u] = sum_x / count + jitter(generator);
+                current.y[u] = sum_y / count + jitter(generator);
+                placed[u] = true;
+            }
+
+            if (waiting.size() == pending.size()) {
+                // No progress: drop the first one in at random
+                const int u = waiting.front();
+                current.x[u] = std::uniform_real_distribution<double>(min_x - offset, max_x + offset)(generator);
+                current.y[u] = std::uniform_real_distribution<double>(min_y - offset, max_y + offset)(generator);
+                placed[u] = true;
+                waiting.erase(waiting.begin());
+            }
+
+            pending = std::move(waiting);
+        }
+    }
+
+    int IncrementalLayout::relax(const std::vector<int>& active, int iterations) {
+        /** Run eades84_2's integrator on the active vertices only. Springs
+         *  pull them toward all of their neighbors, and the electrical force
+         *  comes from every vertex within the cutoff of the region around
+         *  them, so each iteration costs time proportional to the size of
+         *  that region rather than of the graph. Returns the number of
+         *  iterations.
+         */
+        const int k = (int)active.size();
+        const double luv = params.luv, kuv1 = params.kuv1, cutoff = params.cutoff * luv;
+
+        // Local copy of the neighborhood: active vertices first, then every
+        // vertex within cutoff + luv of their bounding box. It holds every
+        // vertex within the cutoff of an active one until some active vertex
+        // has moved more than luv since it was gathered.
+        std::vector<double> lx, ly, gathered_x, gathered_y;
+        auto gather = [&]() {
+            double min_x = INFINITY, max_x = -INFINITY, min_y = INFINITY, max_y = -INFINITY;
+            std::vector<char> is_active(current.size(), false);
+            lx.clear();
+            ly.clear();
+            for (int u : active) {
+                is_active[u] = true;
+                lx.push_back(current.x[u]);
+                ly.push_back(current.y[u]);
+                min_x = std::min(min_x, current.x[u]);
+                max_x = std::max(max_x, current.x[u]);
+                min_y = std::min(min_y, current.y[u]);
+                max_y = std::max(max_y, current.y[u]);
+            }
+
+            const double margin = cutoff + luv;
+            for (int u = 0; u < current.size(); u++) {
+                if (current.x[u] < min_x - margin || current.x[u] > max_x + margin ||
+                    current.y[u] < min_y - margin || current.y[u] > max_y + margin || is_active[u]) continue;
+                lx.push_back(current.x[u]);
+                ly.push_back(current.y[u]);
+            }
+
+            gathered_x.assign(lx.begin(), lx.begin() + k);
+            gathered_y.assign(ly.begin(), ly.begin() + k);
+        };
+
+        gather();
+        workspace.grid.build(lx, ly, cutoff);
+
+        CSRAdjacency adjacent; // Rows are active vertices, entries dense indices
+        adjacent.offsets.push_back(0);
+        for (int u : active) {
+            auto node = g.GetNI(current.ids[u]);
+            for (int n = 0; n < node.GetDeg(); n++) {
+                int v = current.index.at(node.GetNbrNId(n));
+                if (v != u) adjacent.neighbors.push_back(v);
+            }
+
+            adjacent.offsets.push_back((int)adjacent.neighbors.size());
+        }
+
+        // New vertices were placed next to their neighbors, so start cool
+        Cooling cooling(0.1 * luv);
+        int it = 0;
+        bool move = k > 0;
+
+        for (; move && it < iterations; it++) {
+            #pragma omp parallel for schedule(dynamic, 64)
+            for (int i = 0; i < k; i++) {
+                const int u = active[i];
+                auto electrical = workspace.grid.repulsion(i, current.x[u], current.y[u], params.kuv2);
+                double sum_x = electrical.first, sum_y = electrical.second;
+
+                for (auto v = adjacent.begin(i); v != adjacent.end(i); v++) {
+                    double length = eades84_helper::distance_between(current, u, *v);
+                    if (length == 0) continue;
+                    sum_x += kuv1 * (length - luv) * (current.x[u] - current.x[*v]) / length;
+                    sum_y += kuv1 * (length - luv) * (current.y[u] - current.y[*v]) / length;
+                }
+
+                current.fx[u] = sum_x;
+                current.fy[u] = sum_y;
+            }
+
+            double energy = 0, moved = 0;
+            for (int i = 0; i < k; i++) {
+                const int u = active[i];
+                double force = sqrt(pow(current.fx[u], 2) + pow(current.fy[u], 2)),
+                    pct = std::min(params.pct, cooling.temperature / force);
+
+                if (isnan(force)) throw std::runtime_error("Failed to converge");
+                if (force == 0) continue;
+
+                current.x[u] -= pct * current.fx[u];
+                current.y[u] -= pct * current.fy[u];
+                lx[i] = current.x[u];
+                ly[i] = current.y[u];
+                energy += force * force;
+                moved += pct * force;
+            }
+
+            cooling.update(energy, params.cooling);
+            move = moved / k >= params.tolerance * luv;
+
+            // Gather the neighborhood again once it might be missing vertices,
+            // and rebuild the grid so moved vertices are in the right cells
+            double furthest = 0;
+            for (int i = 0; i < k; i++)
+                furthest = std::max(furthest, std::hypot(lx[i] - gathered_x[i], ly[i] - gathered_y[i]));
+            if (furthest > luv) gather();
+            workspace.grid.build(lx, ly, cutoff);
+        }
+
+        return it;
+    }
+
+    int IncrementalLayout::update(const IncrementalParams& options) {
+        /** Lay out the edits made since the last update */
+        place();
+
+        // Breadth first search out to options.hops from every touched vertex
+        std::vector<int> active;
+        std::unordered_map<int, int> depth;
+        for (int id : touched) {
+            if (!g.IsNode(id)) continue;
+            const int u = current.index.at(id);
+            depth[u] = 0;
+            active.push_back(u);
+        }
+
+        touched.clear();
+        for (size_t head = 0; head < active.size(); head++) {
+            const int u = active[head], d = depth[u];
+            if (d >= options.hops) continue;
+
+            auto node = g.GetNI(current.ids[u]);
+            for (int n = 0; n < node.GetDeg(); n++) {
+                const int v = current.index.at(node.GetNbrNId(n));
+                if (depth.count(v)) continue;
+                depth[v] = d + 1;
+                active.push_back(v);
+            }
+        }
+
+        relax(active, options.local_iterations);
+
+        if (options.polish_iterations > 0) {
+            CSRAdjacency adjacent(g, current);
+            Cooling cooling(0.1 * params.luv);
+            for (int i = 0; i < options.polish_iterations; i++)
+                if (!eades84_helper::step(params, adjacent, current, workspace, cooling)) break;
+        }
+
+        return (int)active.size();
+    }
+}
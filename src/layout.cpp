@@ -1,10 +1,41 @@
 #include "force_directed.h"
 #include <chrono>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 namespace force_directed {
-    VertexPos random_layout(TUNGraph& graph) {
-        VertexPos pos;
+    void set_threads(int threads) {
+        /** Set the number of threads used by the layout engines. 0 keeps the
+         *  OpenMP runtime's default, so OMP_NUM_THREADS is respected.
+         */
+#ifdef _OPENMP
+        static const int runtime_default = omp_get_max_threads(); // Before any call changes it
+        omp_set_num_threads(threads > 0 ? threads : runtime_default);
+#else
+        (void)threads;
+#endif
+    }
+
+    FrameRecorder::FrameRecorder(const FrameCallback& callback, const FrameOptions& options) :
+        callback(callback), options(options) {};
+
+    void FrameRecorder::record(const LayoutState& state, int iteration) {
+        /** Pass state on if the options ask for this iteration */
+        if (!options.final_only && iteration % std::max(1, options.stride) == 0) {
+            callback(state, iteration);
+            last = iteration;
+        }
+    }
+
+    void FrameRecorder::finish(const LayoutState& state, int iteration) {
+        /** Always pass on the final positions, unless we just did */
+        if (last != iteration) callback(state, iteration);
+        last = iteration;
+    }
 
+    VertexPos random_layout(TUNGraph& graph) {
         // Iterate over vertices, assigning random coordinates
         typedef std::chrono::high_resolution_clock myclock;
         myclock::time_point beginning = myclock::now();
@@ -13,6 +44,11 @@ namespace force_directed {
         myclock::duration d = myclock::now() - beginning;
         unsigned seed = d.count();
 
+        return random_layout(graph, seed);
+    }
+
+    VertexPos random_layout(TUNGraph& graph, unsigned seed) {
+        VertexPos pos;
         std::mt19937 generator(seed);
         std::uniform_real_distribution<double> distribution(0.0, 500.0);
 
@@ -44,137 +80,269 @@ namespace force_directed {
     }
 
     std::vector<SVG::SVG> eades84(TUNGraph& graph, VertexPos& pos) {
-        /** An attempt to implement Eades' algorithm as described in his 1984 paper */
-        AdjacencyList adj = adjacency_list(graph), not_adj;
         std::vector<SVG::SVG> ret;
+        eades84(graph, pos, [&](const LayoutState& state, int) {
+            ret.push_back(draw_graph(graph, state));
+        });
 
-        // Compute non-adjacency list
-        for (auto& pair : adj) {
-            auto& u = pair.first;
-            auto& u_adj = pair.second;
+        return ret;
+    }
 
-            for (auto v = graph.BegNI(); v != graph.EndNI(); v++) {
-                int v_id = v.GetId();
-                if ((u_adj.find(v_id) == u_adj.end()) &&
-                    u != v_id) not_adj[u].insert(v_id);
-            }
-        }
+    void eades84(TUNGraph& graph, VertexPos& pos,
+        const FrameCallback& callback, const FrameOptions& options) {
+        /** An attempt to implement Eades' algorithm as described in his 1984 paper */
+        LayoutState state(graph, pos);
+        CSRAdjacency adj(graph, state);
+        FrameRecorder frames(callback, options);
 
         const double c1 = 2.0, c2 = 1.0, c3 = 1.0, c4 = 0.1;
-        const int m = 100;
+        const int m = 100, n = state.size();
+        auto &x = state.x, &y = state.y;
 
         // Initial positions
-        ret.push_back(draw_graph(graph, pos));
+        frames.record(state, 0);
 
         for (int i = 0; i < m; i++) {
             // Calculate force on each vertex
-            for (auto u = graph.BegNI(); u != graph.EndNI(); u++) {
+            for (int u = 0; u < n; u++) {
                 double force = 0;
-                int u_id = u.GetId();
 
                 // Iterate over adjacent vertices
-                for (auto& v : adj[u_id]) {
+                for (auto v = adj.begin(u); v != adj.end(u); v++) {
                     force += c1 * log10(
-                        sqrt(pow(pos[u_id].first - pos[v].first, 2)
-                            + pow(pos[u_id].second - pos[v].second, 2))
+                        sqrt(pow(x[u] - x[*v], 2) + pow(y[u] - y[*v], 2))
                         / c2);
                 }
 
-                // Iterate over non-adjacent vertices
-                for (auto& v : not_adj[u_id]) {
-                    force += c3 / sqrt(sqrt(pow(pos[u_id].first - pos[v].first, 2)
-                        + pow(pos[u_id].second - pos[v].second, 2)));
+                // Iterate over non-adjacent vertices: the runs of vertices
+                // between consecutive entries of the sorted neighbor list
+                // (isolated vertices feel no repulsion)
+                if (adj.degree(u) > 0) {
+                    const int* next = adj.begin(u);
+                    for (int from = 0; ; next++) {
+                        const int to = next != adj.end(u) ? *next : n;
+                        for (int v = from; v < to; v++) {
+                            double dx = x[u] - x[v], dy = y[u] - y[v];
+                            force += v == u ? 0 : c3 / sqrt(sqrt(dx * dx + dy * dy));
+                        }
+
+                        if (to == n) break;
+                        from = to + 1;
+                    }
                 }
 
                 // Move vertex
-                pos[u_id].first += (c4 * force);
-                pos[u_id].second += (c4 * force);
+                x[u] += (c4 * force);
+                y[u] += (c4 * force);
             }
 
-            ret.push_back(draw_graph(graph, pos));
+            frames.record(state, i + 1);
         }
 
-        return ret;
+        frames.finish(state, m);
+        state.store(pos);
     }
 
     namespace eades84_helper {
-        double distance_between(VertexPos& pos, int node1, int node2) {
-            auto &pos1 = pos[node1], &pos2 = pos[node2];
-            return sqrt(
-                pow(pos1.first - pos2.first, 2) +
-                pow(pos1.second - pos2.second, 2)
-            );
+        double distance_between(const LayoutState& state, int node1, int node2) {
+            double dx = state.x[node1] - state.x[node2],
+                dy = state.y[node1] - state.y[node2];
+            return sqrt(dx * dx + dy * dy);
         }
 
-        Point calculate_force(ForceDirectedParams& params, TUNGraph& graph, int node,
-            AdjacencyList& adjacent, VertexPos& pos) {
-            // Calculate the force on one node
+        Point spring_force(ForceDirectedParams& params, int node,
+            const CSRAdjacency& adjacent, const LayoutState& state) {
+            // Calculate the spring force on one node (by dense index)
             double sum_x = 0, sum_y = 0;
-            double& luv = params.luv, kuv1 = params.kuv1, kuv2 = params.kuv2;
+            double& luv = params.luv, kuv1 = params.kuv1;
+            auto &x = state.x, &y = state.y;
 
             // Iterate over adjacent vertices
-            for (auto adj : adjacent[node]) {
-                double length = distance_between(pos, adj, node);
-                sum_x += kuv1 * (length - luv) * (pos[node].first - pos[adj].first) / length;
-                sum_y += kuv1 * (length - luv) * (pos[node].second - pos[adj].second) / length;
+            for (auto it = adjacent.begin(node); it != adjacent.end(node); it++) {
+                int adj = *it;
+                double length = distance_between(state, adj, node);
+                sum_x += kuv1 * (length - luv) * (x[node] - x[adj]) / length;
+                sum_y += kuv1 * (length - luv) * (y[node] - y[adj]) / length;
             }
 
-            // Iterate over vertices X vertices
-            for (auto vertex = graph.BegNI(); vertex < graph.EndNI(); vertex++) {
-                int v_id = vertex.GetId();
-                double dist = distance_between(pos, v_id, node);
+            return std::make_pair(sum_x, sum_y);
+        }
 
-                if (node != vertex.GetId()) {
-                    sum_x += (kuv2 / pow(dist, 2)) * (pos[node].first - pos[v_id].first) / dist;
-                    sum_y += (kuv2 / pow(dist, 2)) * (pos[node].second - pos[v_id].second) / dist;
+        Point calculate_force(ForceDirectedParams& params, int node,
+            const CSRAdjacency& adjacent, const LayoutState& state) {
+            // Calculate the force on one node (by dense index)
+            auto spring = spring_force(params, node, adjacent, state);
+            double sum_x = spring.first, sum_y = spring.second;
+            double& kuv2 = params.kuv2;
+            auto &x = state.x, &y = state.y;
+
+            // Iterate over vertices X vertices
+            for (int v = 0; v < state.size(); v++) {
+                if (node != v) {
+                    double dist = distance_between(state, v, node);
+                    sum_x += (kuv2 / (dist * dist)) * (x[node] - x[v]) / dist;
+                    sum_y += (kuv2 / (dist * dist)) * (y[node] - y[v]) / dist;
                 }
             }
 
             return std::make_pair(sum_x, sum_y);
         }
-    }
 
-    std::vector<SVG::SVG> eades84_2(ForceDirectedParams& params, TUNGraph& graph, VertexPos& pos) {
-        /** Use Eades' spring layout algorithm, creating a frame between each iteration */
-        std::vector<SVG::SVG> ret;
-        AdjacencyList adjacent = adjacency_list(graph); // Optimization
-        std::map<TUNGraph::TNodeI, Point> forces;
-        ret.push_back(draw_graph(graph, pos)); // Record initial positions
+        Point calculate_force(ForceDirectedParams& params, int node,
+            const CSRAdjacency& adjacent, const LayoutState& state, const QuadTree& tree) {
+            // Calculate the force on one node, using a Barnes-Hut approximation
+            // for the electrical force
+            auto spring = spring_force(params, node, adjacent, state),
+                electrical = tree.repulsion(node, state.x[node], state.y[node],
+                    params.kuv2, params.theta);
+            return std::make_pair(spring.first + electrical.first,
+                spring.second + electrical.second);
+        }
 
-        bool move = true;
-        const int MAX_ITERATIONS = 1000;
-        for (int i = 0; move && i < MAX_ITERATIONS; i++) {
-            for (auto node = graph.BegNI(); node < graph.EndNI(); node++) {
-                auto force = eades84_helper::calculate_force(params, graph, node.GetId(), adjacent, pos);
-                forces[node] = force;
+        void calculate_forces(ForceDirectedParams& params, const CSRAdjacency& adjacent,
+            LayoutState& state, ForceWorkspace& workspace) {
+            /** Fill in state.fx and state.fy for every vertex. Each force only
+             *  reads positions, so vertices are split across threads.
+             */
+            const int n = state.size();
+
+            if (params.repulsion == Repulsion::BARNES_HUT) {
+                // Rebuild the quadtree over this iteration's positions
+                workspace.tree.build(state.x, state.y);
+
+                #pragma omp parallel for schedule(dynamic, 64)
+                for (int node = 0; node < n; node++) {
+                    auto force = calculate_force(params, node, adjacent, state, workspace.tree);
+                    state.fx[node] = force.first;
+                    state.fy[node] = force.second;
+                }
             }
+            else if (params.repulsion == Repulsion::FMM) {
+                workspace.fmm.evaluate(state.x, state.y, params.kuv2, params.fmm_order,
+                    state.fx, state.fy);
+
+                #pragma omp parallel for schedule(dynamic, 64)
+                for (int node = 0; node < n; node++) {
+                    auto spring = spring_force(params, node, adjacent, state);
+                    state.fx[node] += spring.first;
+                    state.fy[node] += spring.second;
+                }
+            }
+            else if (params.repulsion == Repulsion::GRID) {
+                // Rebucket this iteration's positions
+                workspace.grid.build(state.x, state.y, params.cutoff * params.luv);
+
+                #pragma omp parallel for schedule(dynamic, 64)
+                for (int node = 0; node < n; node++) {
+                    auto spring = spring_force(params, node, adjacent, state),
+                        electrical = workspace.grid.repulsion(node, state.x[node], state.y[node], params.kuv2);
+                    state.fx[node] = spring.first + electrical.first;
+                    state.fy[node] = spring.second + electrical.second;
+                }
+            }
+            else {
+                // Vectorized all-pairs electrical force, one block of targets at a time
+                const int BLOCK = 256;
+                const simd::Isa isa = simd::detect();
+
+                #pragma omp parallel for schedule(dynamic, 1)
+                for (int begin = 0; begin < n; begin += BLOCK) {
+                    const int end = std::min(n, begin + BLOCK);
+                    simd::repulsion(isa, state.x.data(), state.y.data(), n, begin, end,
+                        params.kuv2, state.fx.data(), state.fy.data());
+
+                    for (int node = begin; node < end; node++) {
+                        auto spring = spring_force(params, node, adjacent, state);
+                        state.fx[node] += spring.first;
+                        state.fy[node] += spring.second;
+                    }
+                }
+            }
+        }
+    }
 
-            // Keep moving as long as forces not zero
-            move = false;
-            for (auto force : forces) {
-                if (!APPROX_EQUALS(sqrt(pow(force.second.first, 2) - pow(force.second.second, 2)), 0, 5))
-                    move = true;
+    void Cooling::update(double energy, double factor) {
+        if (energy < this->energy) {
+            if (++progress >= 5) {
+                progress = 0;
+                temperature /= factor;
             }
+        }
+        else {
+            progress = 0;
+            temperature *= factor;
+        }
+
+        this->energy = energy;
+    }
+
+    namespace eades84_helper {
+        bool step(ForceDirectedParams& params, const CSRAdjacency& adjacent,
+            LayoutState& state, ForceWorkspace& workspace, Cooling& cooling) {
+            /** Perform one iteration of eades84_2, returning false once the
+             *  mean distance moved falls below params.tolerance * params.luv
+             */
+            const int n = state.size();
+            calculate_forces(params, adjacent, state, workspace);
 
             // Move nodes...
-            for (auto force : forces) {
-                // ... in the direction of the force by a distance proportional to the magnitude of the force
-                auto &force_x = force.second.first, &force_y = force.second.second;
-                auto node = force.first.GetId();
-                double pct = 0.1;
-
-                if (isnan(force_x)) throw std::runtime_error("Failed to converge");
-                pos[node].first -= pct * force_x;
-                pos[node].second -= pct * force_y;
+            double energy = 0, moved = 0;
+            for (int node = 0; node < n; node++) {
+                // ... in the direction of the force by a distance proportional to the
+                // magnitude of the force, but no further than the temperature
+                double force = sqrt(pow(state.fx[node], 2) + pow(state.fy[node], 2)),
+                    pct = std::min(params.pct, cooling.temperature / force);
+
+                if (isnan(force)) throw std::runtime_error("Failed to converge");
+                if (force == 0) continue;
+
+                state.x[node] -= pct * state.fx[node];
+                state.y[node] -= pct * state.fy[node];
+                energy += force * force;
+                moved += pct * force;
             }
 
-            // Add frame
-            ret.push_back(draw_graph(graph, pos));
+            cooling.update(energy, params.cooling);
+            return n > 0 && moved / n >= params.tolerance * params.luv;
         }
+    }
+
+    std::vector<SVG::SVG> eades84_2(ForceDirectedParams& params, TUNGraph& graph, VertexPos& pos) {
+        /** Use Eades' spring layout algorithm, creating a frame between each iteration */
+        std::vector<SVG::SVG> ret;
+        eades84_2(params, graph, pos, [&](const LayoutState& state, int) {
+            ret.push_back(draw_graph(graph, state));
+        });
 
         return ret;
     }
 
+    void eades84_2(ForceDirectedParams& params, TUNGraph& graph, VertexPos& pos,
+        const FrameCallback& callback, const FrameOptions& options) {
+        /** Use Eades' spring layout algorithm, passing positions to callback
+         *  as specified by options
+         */
+        LayoutState state(graph, pos);
+        CSRAdjacency adjacent(graph, state); // Optimization
+        FrameRecorder frames(callback, options);
+        frames.record(state, 0); // Record initial positions
+
+        bool move = true;
+        ForceWorkspace workspace;
+        Cooling cooling(params.luv);
+
+        int i = 0;
+        for (; move && i < params.max_iterations; i++) {
+            move = eades84_helper::step(params, adjacent, state, workspace, cooling);
+
+            // Add frame
+            frames.record(state, i + 1);
+        }
+
+        frames.finish(state, i);
+        state.store(pos);
+    }
+
     SVG::SVG draw_graph(TUNGraph& graph, VertexPos& pos, const double width) {
         SVG::SVG root;
         auto edges = root.add_child<SVG::Group>(), vertices = root.add_child<SVG::Group>();
@@ -182,7 +350,7 @@ namespace force_directed {
 
         // Map IDs to nodes
         std::map<int, SVG::Circle*> nodes;
-        const double circle_radius = std::max(5.0, width / 50);
+        const double circle_radius = vertex_radius(width);
 
 
         // Draw vertices
@@ -203,118 +371,72 @@ namespace force_directed {
         return root;
     }
 
-    std::vector<SVG::SVG> barycenter_layout(TUNGraph& graph, const size_t fixed_vertices, const double width) {
-        VertexPos pos;
-        std::vector<SVG::SVG> ret;
-        std::set<TUNGraph::TNodeI> fixed, free;
-        std::vector<Point> polygon = SVG::util::polar_points((int)fixed_vertices, 0, 0, width/2);
+    SVG::SVG draw_graph(TUNGraph& graph, const LayoutState& state, const double width) {
+        SVG::SVG root;
+        auto edges = root.add_child<SVG::Group>(), vertices = root.add_child<SVG::Group>();
+        edges->set_attr("stroke", "black").set_attr("stroke-width", "1px");
 
-        auto node = graph.BegNI();
-        auto point = polygon.begin();
-        for (; (node < graph.EndNI()) && (fixed.size() < fixed_vertices); node++) {
-            fixed.insert(node);
+        const double circle_radius = vertex_radius(width);
 
-            // Place along polygon
-            pos[node.GetId()] = std::make_pair(point->first, point->second);
-            point++;
-        }
+        // Draw vertices
+        for (int i = 0; i < state.size(); i++)
+            vertices->add_child<SVG::Circle>(std::make_pair(state.x[i], state.y[i]), circle_radius);
 
-        for (; node < graph.EndNI(); node++) {
-            free.insert(node);
-            pos[node.GetId()] = std::make_pair(0, 0); // Place free vertices at origin
+        for (auto edge = graph.BegEI(); edge < graph.EndEI(); edge++) {
+            int u = state.index.at(edge.GetSrcNId()), v = state.index.at(edge.GetDstNId());
+            edges->add_child<SVG::Line>(state.x[u], state.x[v], state.y[u], state.y[v]);
         }
 
-        // Draw initial positions
-        ret.push_back(draw_graph(graph, pos));
-
-        // Optimization: Keep a list of adjacent vertices
-        std::map<int, VertexSet> adjacent = adjacency_list(graph);
-
-        bool converge;
-        do {
-            converge = true;
-            for (auto node : free) {
-                int node_id = node.GetId();
-                auto current_xy = pos[node_id];
-                double sum_x = 0, sum_y = 0, new_x, new_y;
-
-                // Sum up adjacent vertices
-                for (auto u : adjacent[node_id]) {
-                    auto u_xy = pos[u];
-                    sum_x += u_xy.first;
-                    sum_y += u_xy.second;
-                }
-
-                pos[node_id].first = (1 / (double)node.GetDeg()) * sum_x;
-                pos[node_id].second = (1 / (double)node.GetDeg()) * sum_y;
-
-                // Convergence test
-                if (!(APPROX_EQUALS(new_x, current_xy.first, 0.01) && APPROX_EQUALS(new_y, current_xy.second, 0.01)))
-                    converge = false;
-            }
+        return root;
+    }
 
-            // Algorithm trace
-            ret.push_back(draw_graph(graph, pos));
-        } while (!converge);
+    std::vector<SVG::SVG> barycenter_layout(TUNGraph& graph, const size_t fixed_vertices, const double width) {
+        std::vector<SVG::SVG> ret;
+        barycenter_layout(graph, fixed_vertices, width, [&](const LayoutState& state, int) {
+            ret.push_back(draw_graph(graph, state));
+        });
 
         return ret;
     }
 
+    void barycenter_layout(TUNGraph& graph, const size_t fixed_vertices, const double width,
+        const FrameCallback& callback, const FrameOptions& options) {
+        /** Jacobi iteration: every free vertex moves to the barycenter of its
+         *  neighbors' previous positions, until the residual has fallen by a
+         *  factor of 1e-4 or after 1000 sweeps. Jacobi needs O(n^2) sweeps
+         *  to converge fully, so this stops well short of the defaults.
+         */
+        BarycenterParams params;
+        params.method = Relaxation::JACOBI;
+        params.tolerance = 1e-4;
+        params.max_iterations = 1000;
+        barycenter_layout(graph, fixed_vertices, width, params, callback, options);
+    }
+
     BarycenterLayout barycenter_layout_la(
         TUNGraph& graph, const size_t fixed_vertices, const double width) {
-        /** Solve the barycenter layout problem using linear algebra */
-        std::vector<TUNGraph::TNodeI> fixed, free;
+        /** Solve the barycenter layout problem using linear algebra, with
+         *  the fixed vertices placed along a polygon
+         */
+        BarycenterSolver solver(graph, fixed_vertices);
         std::vector<Point> polygon = SVG::util::polar_points((int)fixed_vertices, 0, 0, width / 2);
-        VertexPos pos;
 
-        auto node = graph.BegNI();
-        auto point = polygon.begin();
-        for (; (node < graph.EndNI()) && (fixed.size() < fixed_vertices); node++) {
-            fixed.push_back(node);
-            pos[node.GetId()] = std::make_pair(point->first, point->second); // Place along polygon
-            point++;
+        MatrixXd fixed_x(solver.fixed_count(), 1), fixed_y(solver.fixed_count(), 1), sol_x, sol_y;
+        for (int u = 0; u < solver.fixed_count(); u++) {
+            fixed_x(u, 0) = polygon[u].first;
+            fixed_y(u, 0) = polygon[u].second;
         }
 
-        for (; node < graph.EndNI(); node++) free.push_back(node);
-
-        MatrixXd points(free.size(), free.size());
-        VectorXd x(free.size()), y(free.size());;
-
-        // Populate the matrix
-        for (int i = 0; i < (int)free.size(); i++) {
-            for (int j = 0; j < (int)free.size(); j++) {
-                if (i == j) points(i, j) = (int)free[i].GetDeg();
-                else if (free[i].IsNbrNId(free[j].GetId())) points(i, j) = -1;
-                else points(i, j) = 0;
-            }
-        }
-
-        // Populate vectors of fixed positions
-        for (size_t i = 0; i < free.size(); i++) {
-            // Sum up fixed vertices adjacent to our free boi
-            double sum_x = 0, sum_y = 0;
-            for (auto& f : fixed) {
-                int f_id = f.GetId();
-                if (free[i].IsNbrNId(f_id)) {
-                    sum_x += pos[f_id].first;
-                    sum_y += pos[f_id].second;
-                }
-            }
-
-            x(i) = sum_x;
-            y(i) = sum_y;
-        }
-
-        // std::cout << "Here is the matrix A:\n" << points << std::endl;
-        // std::cout << "Here is the vector b:\n" << x << std::endl;
-        VectorXd sol_x = points.fullPivHouseholderQr().solve(x),
-            sol_y = points.fullPivHouseholderQr().solve(y);
-        // std::cout << "The solution is:\n" << sol_x << std::endl;
+        solver.solve(fixed_x, fixed_y, sol_x, sol_y);
 
         // Set graph positions
-        for (size_t i = 0; i < sol_x.size(); i++)
-            pos[free[i].GetId()] = std::make_pair(sol_x(i), sol_y(i));
+        VertexPos pos;
+        for (int u = 0; u < solver.fixed_count(); u++) pos[solver.id(u)] = polygon[u];
+        for (int i = 0; i < solver.free_count(); i++)
+            pos[solver.id(solver.fixed_count() + i)] = std::make_pair(sol_x(i, 0), sol_y(i, 0));
 
-        return { draw_graph(graph, pos), points, x, y, sol_x, sol_y };
+        return { draw_graph(graph, pos), solver.matrix(),
+            solver.coupling() * fixed_x.col(0), solver.coupling() * fixed_y.col(0),
+            sol_x.col(0), sol_y.col(0), pos };
     }
 }
\ No newline at end of file
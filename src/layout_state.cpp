@@ -0,0 +1,94 @@
+#include "force_directed.h"
+#include <algorithm>
+
+namespace force_directed {
+    LayoutState::LayoutState(int n) : x(n, 0), y(n, 0), fx(n, 0), fy(n, 0) {
+        /** Anonymous state for n vertices, e.g. a coarsened graph (ids are
+         *  0 ... n - 1 and index is left empty)
+         */
+        ids.resize(n);
+        for (int i = 0; i < n; i++) ids[i] = i;
+    }
+
+    LayoutState::LayoutState(TUNGraph& graph) {
+        /** Assign dense indices to every vertex, placing all of them at the origin */
+        const int n = graph.GetNodes();
+        ids.reserve(n);
+        index.reserve(n);
+
+        for (auto node = graph.BegNI(); node < graph.EndNI(); node++) {
+            index[node.GetId()] = (int)ids.size();
+            ids.push_back(node.GetId());
+        }
+
+        x.assign(n, 0);
+        y.assign(n, 0);
+        fx.assign(n, 0);
+        fy.assign(n, 0);
+    }
+
+    LayoutState::LayoutState(TUNGraph& graph, VertexPos& pos) : LayoutState(graph) {
+        /** Copy positions in from a map (vertices missing from pos go at the origin) */
+        for (int i = 0; i < size(); i++) {
+            auto it = pos.find(ids[i]);
+            if (it != pos.end()) {
+                x[i] = it->second.first;
+                y[i] = it->second.second;
+            }
+        }
+    }
+
+    void LayoutState::store(VertexPos& pos) const {
+        /** Copy positions back out to a map */
+        for (int i = 0; i < size(); i++)
+            pos[ids[i]] = std::make_pair(x[i], y[i]);
+    }
+
+    VertexPos LayoutState::to_pos() const {
+        VertexPos pos;
+        store(pos);
+        return pos;
+    }
+
+    CSRAdjacency::CSRAdjacency(TUNGraph& graph, const LayoutState& state) {
+        /** Build in one pass over each vertex's edges, in dense index order */
+        const int n = state.size();
+        offsets.reserve(n + 1);
+        neighbors.reserve(2 * (size_t)graph.GetEdges());
+        offsets.push_back(0);
+
+        for (int u = 0; u < n; u++) {
+            auto node = graph.GetNI(state.ids[u]);
+            for (int k = 0; k < node.GetDeg(); k++) {
+                int v = state.index.at(node.GetNbrNId(k));
+                if (v != u) neighbors.push_back(v); // Self-loops exert no force
+            }
+
+            std::sort(neighbors.begin() + offsets[u], neighbors.end());
+            offsets.push_back((int)neighbors.size());
+        }
+    }
+
+    bool CSRAdjacency::adjacent(int u, int v) const {
+        return std::binary_search(begin(u), end(u), v);
+    }
+
+    void scale_edge_length(LayoutState& state, const CSRAdjacency& adjacent, double edge_length) {
+        /** Scale positions about the origin so that the mean edge is edge_length long */
+        double total = 0;
+        long long edges = 0;
+        for (int u = 0; u < adjacent.size(); u++) {
+            for (auto v = adjacent.begin(u); v != adjacent.end(u); v++) {
+                total += std::hypot(state.x[u] - state.x[*v], state.y[u] - state.y[*v]);
+                edges++;
+            }
+        }
+
+        if (total == 0) return;
+        const double scale = edge_length * edges / total;
+        for (int v = 0; v < state.size(); v++) {
+            state.x[v] *= scale;
+            state.y[v] *= scale;
+        }
+    }
+}
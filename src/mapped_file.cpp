@@ -0,0 +1,73 @@
+#include "mapped_file.h"
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace force_directed {
+#ifdef _WIN32
+    MappedFile::MappedFile(const std::string& file) {
+        file_handle = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file_handle == INVALID_HANDLE_VALUE) {
+            file_handle = nullptr;
+            throw std::runtime_error("Could not open " + file);
+        }
+
+        LARGE_INTEGER size;
+        GetFileSizeEx(file_handle, &size);
+        length = (size_t)size.QuadPart;
+        if (length == 0) return; // Empty files can't be mapped
+
+        mapping = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping) begin = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!begin) {
+            if (mapping) CloseHandle(mapping);
+            CloseHandle(file_handle);
+            throw std::runtime_error("Could not map " + file);
+        }
+    }
+
+    MappedFile::~MappedFile() {
+        if (begin) UnmapViewOfFile(begin);
+        if (mapping) CloseHandle(mapping);
+        if (file_handle) CloseHandle(file_handle);
+    }
+#else
+    MappedFile::MappedFile(const std::string& file) {
+        const int fd = open(file.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("Could not open " + file);
+
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            close(fd);
+            throw std::runtime_error("Could not read the size of " + file);
+        }
+
+        length = (size_t)info.st_size;
+        if (length > 0) {
+            void* address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("Could not map " + file);
+            }
+
+            begin = (const char*)address;
+            madvise(address, length, MADV_SEQUENTIAL);
+        }
+
+        close(fd); // The mapping keeps the file open
+    }
+
+    MappedFile::~MappedFile() {
+        if (begin) munmap((void*)begin, length);
+    }
+#endif
+}
@@ -0,0 +1,42 @@
+// Read-only memory mapped files
+
+#pragma once
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace force_directed {
+    /** Whether this machine stores integers and floats little-endian, as the
+     *  binary files read in place from a mapping are written
+     */
+    inline bool little_endian_host() {
+        const uint16_t one = 1;
+        unsigned char first;
+        memcpy(&first, &one, 1);
+        return first == 1;
+    }
+
+    class MappedFile {
+        /** Maps a whole file into memory for reading, so that large inputs
+         *  can be parsed in place without copying them into buffers first.
+         *  Pages are read in by the operating system as they are touched.
+         */
+    public:
+        explicit MappedFile(const std::string& file);
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const char* data() const { return begin; }
+        size_t size() const { return length; }
+
+    private:
+        const char* begin = nullptr;
+        size_t length = 0;
+#ifdef _WIN32
+        void* file_handle = nullptr;
+        void* mapping = nullptr;
+#endif
+    };
+}
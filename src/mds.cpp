@@ -0,0 +1,52 @@
+#include "force_directed.h"
+#include <algorithm>
+
+namespace force_directed {
+    VertexPos pivot_mds_layout(TUNGraph& graph, const double edge_length, const int pivots, unsigned seed) {
+        /** Pivot MDS (Brandes and Pich 2006): classical multidimensional
+         *  scaling of the graph-theoretic distances, with the full distance
+         *  matrix replaced by the distances to a few max-min pivots. Costs
+         *  one breadth first search per pivot plus an eigendecomposition of
+         *  a pivots x pivots matrix.
+         */
+        LayoutState state(graph);
+        CSRAdjacency adjacent(graph, state);
+        const int n = state.size(), k = std::min(pivots, n);
+        if (k < 3) return random_layout(graph, seed);
+
+        std::vector<std::vector<int>> dist;
+        stress_helper::maxmin_pivots(adjacent, k, seed, dist);
+
+        // Vertices in other components are put one hop past the furthest vertex
+        int furthest = 0;
+        for (auto& row : dist) furthest = std::max(furthest, *std::max_element(row.begin(), row.end()));
+
+        // Double center the squared distances
+        MatrixXd c(n, k);
+        for (int p = 0; p < k; p++) {
+            for (int v = 0; v < n; v++) {
+                double d = dist[p][v] < 0 ? furthest + 1 : dist[p][v];
+                c(v, p) = d * d;
+            }
+        }
+
+        VectorXd row_mean = c.rowwise().mean(), col_mean = c.colwise().mean().transpose();
+        const double mean = c.mean();
+        for (int p = 0; p < k; p++)
+            for (int v = 0; v < n; v++)
+                c(v, p) = -0.5 * (c(v, p) - row_mean(v) - col_mean(p) + mean);
+
+        // The two leading eigenvectors of C^T C, projected back through C
+        Eigen::SelfAdjointEigenSolver<MatrixXd> eigen(c.transpose() * c);
+        VectorXd x = c * eigen.eigenvectors().col(k - 1),
+            y = c * eigen.eigenvectors().col(k - 2);
+
+        for (int v = 0; v < n; v++) {
+            state.x[v] = x(v);
+            state.y[v] = y(v);
+        }
+
+        scale_edge_length(state, adjacent, edge_length);
+        return state.to_pos();
+    }
+}
@@ -0,0 +1,166 @@
+#include "force_directed.h"
+#include <algorithm>
+#include <numeric>
+
+namespace force_directed {
+    namespace multilevel_helper {
+        CSRAdjacency coarsen(const CSRAdjacency& fine, std::vector<int>& parent, std::mt19937& generator) {
+            /** Collapse a random maximal matching, so every matched pair of
+             *  adjacent vertices becomes one coarse vertex. Afterwards,
+             *  parent maps each fine vertex to its coarse vertex.
+             */
+            const int n = fine.size();
+            std::vector<int> order(n);
+            std::iota(order.begin(), order.end(), 0);
+            std::shuffle(order.begin(), order.end(), generator);
+
+            // Match each vertex with its unmatched neighbor of least degree,
+            // so that hubs don't absorb their whole neighborhood over a few levels
+            int coarse_n = 0;
+            parent.assign(n, -1);
+            for (int u : order) {
+                if (parent[u] >= 0) continue;
+
+                int match = -1;
+                for (auto v = fine.begin(u); v != fine.end(u); v++) {
+                    if (parent[*v] < 0 && (match < 0 || fine.degree(*v) < fine.degree(match)))
+                        match = *v;
+                }
+
+                parent[u] = coarse_n;
+                if (match >= 0) parent[match] = coarse_n;
+                coarse_n++;
+            }
+
+            // Group fine vertices by coarse vertex (counting sort)
+            std::vector<int> first(coarse_n + 1, 0), members(n);
+            for (int u = 0; u < n; u++) first[parent[u] + 1]++;
+            for (int c = 0; c < coarse_n; c++) first[c + 1] += first[c];
+
+            std::vector<int> fill(first.begin(), first.end() - 1);
+            for (int u = 0; u < n; u++) members[fill[parent[u]]++] = u;
+
+            // Coarse edges are fine edges between different coarse vertices
+            CSRAdjacency coarse;
+            coarse.offsets.reserve(coarse_n + 1);
+            coarse.neighbors.reserve(fine.neighbors.size());
+            coarse.offsets.push_back(0);
+
+            for (int c = 0; c < coarse_n; c++) {
+                const int row = (int)coarse.neighbors.size();
+                for (int m = first[c]; m < first[c + 1]; m++) {
+                    for (auto v = fine.begin(members[m]); v != fine.end(members[m]); v++)
+                        if (parent[*v] != c) coarse.neighbors.push_back(parent[*v]);
+                }
+
+                std::sort(coarse.neighbors.begin() + row, coarse.neighbors.end());
+                coarse.neighbors.erase(
+                    std::unique(coarse.neighbors.begin() + row, coarse.neighbors.end()),
+                    coarse.neighbors.end());
+                coarse.offsets.push_back((int)coarse.neighbors.size());
+            }
+
+            return coarse;
+        }
+    }
+
+    std::vector<SVG::SVG> eades84_multilevel(ForceDirectedParams& params, TUNGraph& graph, VertexPos& pos) {
+        std::vector<SVG::SVG> ret;
+        eades84_multilevel(params, graph, pos, [&](const LayoutState& state, int) {
+            ret.push_back(draw_graph(graph, state));
+        });
+
+        return ret;
+    }
+
+    void eades84_multilevel(ForceDirectedParams& params, TUNGraph& graph, VertexPos& pos,
+        const FrameCallback& callback, const FrameOptions& options, const int level_iterations) {
+        /** Multilevel version of eades84_2 (Walshaw 2000): coarsen the graph
+         *  by collapsing matchings until it stops shrinking, lay out the
+         *  coarsest graph, then interpolate and refine level by level.
+         *  Coarse levels run for at most level_iterations, and the original
+         *  graph for at most params.max_iterations. Only iterations on the
+         *  original graph are passed to callback.
+         */
+        const int MIN_VERTICES = 32;
+        const double LEVEL_SCALE = sqrt(7.0 / 4.0); // Natural length grows by this per level
+        std::mt19937 generator(0); // Fixed seed: same input, same layout
+
+        LayoutState state(graph, pos);
+        std::vector<CSRAdjacency> levels;
+        std::vector<std::vector<int>> parents; // parents[l] maps level l to level l + 1
+        levels.push_back(CSRAdjacency(graph, state));
+
+        while (levels.back().size() > MIN_VERTICES) {
+            std::vector<int> parent;
+            CSRAdjacency coarse = multilevel_helper::coarsen(levels.back(), parent, generator);
+            if (coarse.size() > 0.9 * levels.back().size()) break; // Matchings stopped helping
+
+            parents.push_back(std::move(parent));
+            levels.push_back(std::move(coarse));
+        }
+
+        // Seed the coarsest level with the centroids of the initial positions
+        LayoutState current = state;
+        for (size_t l = 0; l + 1 < levels.size(); l++) {
+            LayoutState coarse(levels[l + 1].size());
+            std::vector<int> count(coarse.size(), 0);
+            for (int u = 0; u < current.size(); u++) {
+                int c = parents[l][u];
+                coarse.x[c] += current.x[u];
+                coarse.y[c] += current.y[u];
+                count[c]++;
+            }
+
+            for (int c = 0; c < coarse.size(); c++) {
+                coarse.x[c] /= count[c];
+                coarse.y[c] /= count[c];
+            }
+
+            current = std::move(coarse);
+        }
+
+        ForceWorkspace workspace;
+        for (int l = (int)levels.size() - 1; l > 0; l--) {
+            ForceDirectedParams level_params = params;
+            level_params.luv = params.luv * pow(LEVEL_SCALE, l);
+
+            Cooling cooling(level_params.luv);
+            for (int i = 0; i < level_iterations; i++)
+                if (!eades84_helper::step(level_params, levels[l], current, workspace, cooling)) break;
+
+            // Interpolate: place each vertex near its coarse vertex, with a
+            // small random offset so that matched pairs don't coincide
+            const std::vector<int>& parent = parents[l - 1];
+            const double offset = 0.05 * level_params.luv;
+            std::uniform_real_distribution<double> jitter(-offset, offset);
+            LayoutState fine(levels[l - 1].size());
+
+            for (int u = 0; u < fine.size(); u++) {
+                fine.x[u] = current.x[parent[u]] + jitter(generator);
+                fine.y[u] = current.y[parent[u]] + jitter(generator);
+            }
+
+            current = std::move(fine);
+        }
+
+        // Refine the original graph
+        state.x = std::move(current.x);
+        state.y = std::move(current.y);
+        FrameRecorder frames(callback, options);
+        frames.record(state, 0);
+
+        // Start cool if the coarse levels already placed every vertex roughly
+        // where it belongs. If nothing was coarsened this is just eades84_2.
+        bool move = true;
+        Cooling cooling(levels.size() > 1 ? 0.1 * params.luv : params.luv);
+        int i = 0;
+        for (; move && i < params.max_iterations; i++) {
+            move = eades84_helper::step(params, levels[0], state, workspace, cooling);
+            frames.record(state, i + 1);
+        }
+
+        frames.finish(state, i);
+        state.store(pos);
+    }
+}
@@ -0,0 +1,155 @@
+#include "quadtree.h"
+#include <algorithm>
+#include <math.h>
+
+namespace force_directed {
+    void QuadTree::build(const std::vector<double>& x, const std::vector<double>& y) {
+        /** Rebuild the tree from scratch over a set of bodies. The tree keeps
+         *  pointers to x and y, so they must outlive any calls to repulsion().
+         */
+        const int n = (int)x.size();
+        this->x = &x;
+        this->y = &y;
+        this->next.assign(n, -1);
+        this->cells.clear();
+        if (n == 0) return;
+
+        // Root cell is the bounding square of all points
+        double min_x = x[0], max_x = min_x, min_y = y[0], max_y = min_y;
+        for (int i = 0; i < n; i++) {
+            min_x = std::min(min_x, x[i]);
+            max_x = std::max(max_x, x[i]);
+            min_y = std::min(min_y, y[i]);
+            max_y = std::max(max_y, y[i]);
+        }
+
+        Cell root;
+        root.cx = (min_x + max_x) / 2;
+        root.cy = (min_y + max_y) / 2;
+        root.half = std::max(max_x - min_x, max_y - min_y) / 2 + 1;
+        cells.reserve(2 * n);
+        cells.push_back(root);
+
+        for (int i = 0; i < n; i++) insert(i);
+        summarize(0);
+    }
+
+    int QuadTree::quadrant(const Cell& cell, double px, double py) const {
+        return (px >= cell.cx ? 1 : 0) + (py >= cell.cy ? 2 : 0);
+    }
+
+    void QuadTree::subdivide(int cell) {
+        /** Split a leaf holding exactly one body into four children */
+        const int first = (int)cells.size();
+        const double half = cells[cell].half / 2;
+
+        for (int q = 0; q < 4; q++) {
+            Cell child;
+            child.cx = cells[cell].cx + (q & 1 ? half : -half);
+            child.cy = cells[cell].cy + (q & 2 ? half : -half);
+            child.half = half;
+            cells.push_back(child);
+        }
+
+        // Push the existing body down a level
+        int body = cells[cell].body;
+        cells[first + quadrant(cells[cell], (*x)[body], (*y)[body])].body = body;
+        cells[cell].body = -1;
+        cells[cell].child = first;
+    }
+
+    void QuadTree::insert(int body) {
+        int cell = 0;
+        for (int depth = 0;; depth++) {
+            if (cells[cell].child < 0) {
+                if (cells[cell].body < 0) {
+                    cells[cell].body = body;
+                    return;
+                }
+                else if (depth >= MAX_DEPTH) {
+                    // Coincident (or nearly so) points: chain them in one leaf
+                    next[body] = cells[cell].body;
+                    cells[cell].body = body;
+                    return;
+                }
+
+                subdivide(cell);
+            }
+
+            cell = cells[cell].child + quadrant(cells[cell], (*x)[body], (*y)[body]);
+        }
+    }
+
+    void QuadTree::summarize(int cell) {
+        /** Compute masses and centers of mass bottom-up */
+        double mass = 0, mx = 0, my = 0;
+        if (cells[cell].child < 0) {
+            for (int b = cells[cell].body; b >= 0; b = next[b]) {
+                mass += 1;
+                mx += (*x)[b];
+                my += (*y)[b];
+            }
+        }
+        else {
+            for (int q = 0; q < 4; q++) {
+                int child = cells[cell].child + q;
+                summarize(child);
+                mass += cells[child].mass;
+                mx += cells[child].mass * cells[child].mx;
+                my += cells[child].mass * cells[child].my;
+            }
+        }
+
+        cells[cell].mass = mass;
+        if (mass > 0) {
+            cells[cell].mx = mx / mass;
+            cells[cell].my = my / mass;
+        }
+    }
+
+    QuadTree::Point QuadTree::repulsion(int i, double px, double py, double kuv2, double theta) const {
+        double sum_x = 0, sum_y = 0;
+        if (cells.empty()) return std::make_pair(sum_x, sum_y);
+
+        // Explicit stack: at most three siblings are pending per level
+        int stack[3 * MAX_DEPTH + 4];
+        int top = 0;
+        stack[top++] = 0;
+
+        while (top > 0) {
+            const Cell& cell = cells[stack[--top]];
+            if (cell.mass == 0) continue;
+
+            if (cell.child < 0) {
+                // Leaf: exact interaction with every body in it
+                for (int b = cell.body; b >= 0; b = next[b]) {
+                    if (b == i) continue;
+                    double dx = px - (*x)[b], dy = py - (*y)[b],
+                        dist = sqrt(dx * dx + dy * dy);
+                    sum_x += (kuv2 / (dist * dist)) * dx / dist;
+                    sum_y += (kuv2 / (dist * dist)) * dy / dist;
+                }
+
+                continue;
+            }
+
+            double dx = px - cell.mx, dy = py - cell.my,
+                dist2 = dx * dx + dy * dy, width = 2 * cell.half;
+
+            // A cell around (px, py) may hold body i itself, so it is always opened
+            bool inside = std::abs(px - cell.cx) <= cell.half && std::abs(py - cell.cy) <= cell.half;
+
+            if (!inside && width * width < theta * theta * dist2) {
+                // Far enough away: treat the cell as one body at its center of mass
+                double dist = sqrt(dist2);
+                sum_x += (kuv2 * cell.mass / dist2) * dx / dist;
+                sum_y += (kuv2 * cell.mass / dist2) * dy / dist;
+            }
+            else {
+                for (int q = 0; q < 4; q++) stack[top++] = cell.child + q;
+            }
+        }
+
+        return std::make_pair(sum_x, sum_y);
+    }
+}
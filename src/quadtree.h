@@ -0,0 +1,48 @@
+// Barnes-Hut quadtree for approximating the electrical force in Eades' algorithm
+
+#pragma once
+#include <vector>
+#include <utility>
+
+namespace force_directed {
+    class QuadTree {
+        /** A point region quadtree where every internal cell stores the
+         *  number of bodies below it and their center of mass
+         */
+    public:
+        using Point = std::pair<double, double>;
+
+        QuadTree() = default;
+
+        /** Build over bodies 0, 1, ..., x.size() - 1 */
+        void build(const std::vector<double>& x, const std::vector<double>& y);
+
+        /** Approximate sum of kuv2 / d^2 * (p - q) / d over every body q except
+         *  body i, opening any cell whose width / distance is at least theta
+         *  or which contains p
+         */
+        Point repulsion(int i, double px, double py, double kuv2, double theta) const;
+
+    private:
+        struct Cell {
+            double cx, cy, half;   // Center and half-width of the cell
+            double mass = 0;       // Number of bodies in this cell
+            double mx = 0, my = 0; // Center of mass
+            int child = -1;        // Index of first of four children, -1 if leaf
+            int body = -1;         // First body in a leaf, -1 if empty
+        };
+
+        // Stop subdividing past this depth so coincident points share a leaf
+        static const int MAX_DEPTH = 48;
+
+        std::vector<Cell> cells;
+        const std::vector<double>* x = nullptr;
+        const std::vector<double>* y = nullptr;
+        std::vector<int> next; // Linked list of bodies sharing a leaf
+
+        void insert(int body);
+        void subdivide(int cell);
+        int quadrant(const Cell& cell, double px, double py) const;
+        void summarize(int cell);
+    };
+}
@@ -0,0 +1,193 @@
+#include "raster.h"
+#include "zlib.h"
+#include <algorithm>
+#include <fstream>
+#include <numeric>
+#include <stdexcept>
+#include <ctype.h>
+#include <math.h>
+
+namespace force_directed {
+    Raster::Raster(int width, int height) : cols(width), rows(height) {
+        if (width < 1 || height < 1 || (double)width * height > 1e10)
+            throw std::runtime_error("Cannot make a " + std::to_string(width) + " x " +
+                std::to_string(height) + " image");
+        pixels.assign((size_t)width * height, 255);
+    }
+
+    void Raster::add_line(double x1, double y1, double x2, double y2, double thickness) {
+        shapes.push_back(Shape{ x1, y1, x2, y2, thickness / 2, false });
+    }
+
+    void Raster::add_circle(double cx, double cy, double r) {
+        shapes.push_back(Shape{ cx, cy, cx, cy, r, true });
+    }
+
+    void Raster::render() {
+        /** Draw every queued shape. Shapes are sorted into the bands of rows
+         *  they reach, and the bands are drawn in parallel, each only
+         *  touching its own rows.
+         */
+        const int bands = (rows + BAND - 1) / BAND;
+        auto band_range = [&](const Shape& s) {
+            // Bands holding any pixel the shape may cover
+            const double top = std::min(s.y1, s.y2) - s.r - 1, bottom = std::max(s.y1, s.y2) + s.r + 1;
+            const int first = (int)std::max(0.0, std::min((double)bands, std::floor(top / BAND))),
+                last = (int)std::max(-1.0, std::min(bands - 1.0, std::floor(bottom / BAND)));
+            return std::make_pair(first, last);
+        };
+
+        // Counting sort of shapes by band
+        std::vector<int> start(bands + 1, 0);
+        for (auto& shape : shapes) {
+            auto range = band_range(shape);
+            for (int b = range.first; b <= range.second; b++) start[b + 1]++;
+        }
+        std::partial_sum(start.begin(), start.end(), start.begin());
+
+        std::vector<int> next(start.begin(), start.end() - 1), order(start.back());
+        for (int s = 0; s < (int)shapes.size(); s++) {
+            auto range = band_range(shapes[s]);
+            for (int b = range.first; b <= range.second; b++) order[next[b]++] = s;
+        }
+
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (int b = 0; b < bands; b++) {
+            const int first_row = b * BAND, last_row = std::min(rows, first_row + BAND);
+            for (int k = start[b]; k < start[b + 1]; k++) draw(shapes[order[k]], first_row, last_row);
+        }
+
+        shapes.clear();
+    }
+
+    void Raster::draw(const Shape& s, int first_row, int last_row) {
+        /** Darken the pixels in rows first_row ... last_row - 1 covered by s.
+         *  A pixel whose center is at distance d from the shape's outline
+         *  (negative inside) is covered by 1/2 - d of it, clamped to [0, 1].
+         */
+        auto shade = [&](int px, int py, double coverage) {
+            if (coverage <= 0) return;
+            uint8_t& pixel = pixels[(size_t)py * cols + px];
+            pixel = (uint8_t)std::lround(pixel * (1 - std::min(1.0, coverage)));
+        };
+
+        const double reach = s.r + 1; // Furthest a covered pixel center can be from the centerline
+        const int top = std::max(first_row, (int)std::floor(std::min(s.y1, s.y2) - reach)),
+            bottom = std::min(last_row - 1, (int)std::ceil(std::max(s.y1, s.y2) + reach));
+
+        if (s.circle) {
+            for (int py = top; py <= bottom; py++) {
+                const double dy = py + 0.5 - s.y1, half = reach * reach - dy * dy;
+                if (half < 0) continue;
+
+                const double span = std::sqrt(half);
+                const int left = std::max(0, (int)std::floor(s.x1 - span)),
+                    right = std::min(cols - 1, (int)std::ceil(s.x1 + span));
+                for (int px = left; px <= right; px++) {
+                    const double dx = px + 0.5 - s.x1;
+                    shade(px, py, s.r + 0.5 - std::sqrt(dx * dx + dy * dy));
+                }
+            }
+
+            return;
+        }
+
+        const double dx = s.x2 - s.x1, dy = s.y2 - s.y1, length2 = dx * dx + dy * dy;
+        for (int py = top; py <= bottom; py++) {
+            const double yc = py + 0.5;
+
+            // The part of the segment within reach of this row
+            double t0 = 0, t1 = 1;
+            if (std::abs(dy) > 1e-12) {
+                t0 = (yc - reach - s.y1) / dy;
+                t1 = (yc + reach - s.y1) / dy;
+                if (t0 > t1) std::swap(t0, t1);
+                t0 = std::max(0.0, t0);
+                t1 = std::min(1.0, t1);
+                if (t0 > t1) continue;
+            }
+
+            const double xa = s.x1 + t0 * dx, xb = s.x1 + t1 * dx;
+            const int left = std::max(0, (int)std::floor(std::min(xa, xb) - reach)),
+                right = std::min(cols - 1, (int)std::ceil(std::max(xa, xb) + reach));
+            for (int px = left; px <= right; px++) {
+                // Distance from the pixel center to the nearest point of the segment
+                const double xc = px + 0.5;
+                double t = length2 > 0 ? ((xc - s.x1) * dx + (yc - s.y1) * dy) / length2 : 0;
+                t = std::max(0.0, std::min(1.0, t));
+                const double ex = xc - (s.x1 + t * dx), ey = yc - (s.y1 + t * dy);
+                shade(px, py, s.r + 0.5 - std::sqrt(ex * ex + ey * ey));
+            }
+        }
+    }
+
+    void Raster::write_ppm(std::ostream& out) const {
+        /** Write the image as a binary (P6) PPM */
+        out << "P6\n" << cols << " " << rows << "\n255\n";
+
+        std::vector<char> row((size_t)cols * 3);
+        for (int y = 0; y < rows; y++) {
+            for (int x = 0; x < cols; x++) row[3 * x] = row[3 * x + 1] = row[3 * x + 2] = (char)at(x, y);
+            out.write(row.data(), row.size());
+        }
+    }
+
+    static void put_u32(std::string& data, uint32_t value) {
+        // PNG integers are big endian
+        for (int shift = 24; shift >= 0; shift -= 8) data += (char)((value >> shift) & 0xFF);
+    }
+
+    static void write_chunk(std::ostream& out, const char* type, const std::string& data) {
+        std::string chunk;
+        put_u32(chunk, (uint32_t)data.size());
+        chunk += type;
+        chunk += data;
+
+        // The CRC covers the type and the data, but not the length
+        uLong crc = crc32(0L, Z_NULL, 0);
+        crc = crc32(crc, (const Bytef*)chunk.data() + 4, (uInt)(chunk.size() - 4));
+        put_u32(chunk, (uint32_t)crc);
+        out.write(chunk.data(), chunk.size());
+    }
+
+    void Raster::write_png(std::ostream& out, int level) const {
+        /** Write the image as an 8-bit grayscale PNG, with the scanlines
+         *  deflated by zlib at the given compression level (0 to 9)
+         */
+        std::string header;
+        put_u32(header, (uint32_t)cols);
+        put_u32(header, (uint32_t)rows);
+        header += std::string("\x08\x00\x00\x00\x00", 5); // Bit depth, grayscale, deflate, no filter, no interlace
+
+        // Each scanline starts with its filter type: none
+        std::vector<Bytef> raw((size_t)(cols + 1) * rows);
+        for (int y = 0; y < rows; y++) {
+            raw[(size_t)y * (cols + 1)] = 0;
+            std::copy(pixels.begin() + (size_t)y * cols, pixels.begin() + (size_t)(y + 1) * cols,
+                raw.begin() + (size_t)y * (cols + 1) + 1);
+        }
+
+        uLongf length = compressBound((uLong)raw.size());
+        std::string compressed(length, '\0');
+        if (compress2((Bytef*)&compressed[0], &length, raw.data(), (uLong)raw.size(), level) != Z_OK)
+            throw std::runtime_error("Could not compress the PNG image data");
+        compressed.resize(length);
+
+        out.write("\x89PNG\r\n\x1a\n", 8);
+        write_chunk(out, "IHDR", header);
+        write_chunk(out, "IDAT", compressed);
+        write_chunk(out, "IEND", "");
+    }
+
+    void Raster::save(const std::string& file) const {
+        std::ofstream out(file, std::ios::binary);
+        if (!out) throw std::runtime_error("Could not open " + file);
+
+        std::string extension = file.size() >= 4 ? file.substr(file.size() - 4) : "";
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        if (extension == ".ppm") write_ppm(out);
+        else write_png(out);
+
+        if (!out) throw std::runtime_error("Could not write " + file);
+    }
+}
@@ -0,0 +1,49 @@
+// Anti-aliased rasterizer for drawings of graphs
+
+#pragma once
+#include <ostream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace force_directed {
+    class Raster {
+        /** A grayscale image of black lines and filled circles on white.
+         *  Shapes are queued by add_line() and add_circle() and drawn by
+         *  render(), which cuts the image into bands of rows and draws the
+         *  bands in parallel. Each pixel is darkened by the fraction of it
+         *  each shape covers. Every band draws its shapes in the order they
+         *  were added, so the image does not depend on the number of threads.
+         */
+    public:
+        Raster(int width, int height);
+
+        /** Coordinates are in pixels, with (0, 0) the top left corner of the image */
+        void add_line(double x1, double y1, double x2, double y2, double thickness = 1);
+        void add_circle(double cx, double cy, double r);
+        void render();
+
+        int width() const { return cols; }
+        int height() const { return rows; }
+        uint8_t at(int x, int y) const { return pixels[(size_t)y * cols + x]; } /** 0 is black, 255 white */
+
+        void write_ppm(std::ostream& out) const;
+        void write_png(std::ostream& out, int level = 6) const;
+        void save(const std::string& file) const; /** PPM for a .ppm file, PNG otherwise */
+
+    private:
+        struct Shape {
+            double x1, y1, x2, y2; // Ends of a line, or the center of a circle twice
+            double r;              // Half the thickness of a line, or the radius of a circle
+            bool circle;
+        };
+
+        int cols, rows;
+        std::vector<uint8_t> pixels;
+        std::vector<Shape> shapes; // Queued for render()
+
+        void draw(const Shape& shape, int first_row, int last_row);
+
+        static const int BAND = 32; // Rows drawn by one task
+    };
+}
@@ -0,0 +1,178 @@
+#include "simd_repulsion.h"
+#include <algorithm>
+#include <math.h>
+
+// Each kernel is compiled for its own instruction set and picked at runtime,
+// so the rest of the program doesn't need -mavx2 etc.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define FD_SIMD_X86
+#define FD_TARGET(isa) __attribute__((target(isa)))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define FD_SIMD_X86
+#define FD_TARGET(isa)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+namespace force_directed {
+    namespace simd {
+        // Number of sources per tile (16 bytes each)
+        const int TILE = 1024;
+
+        /** Add the force from sources [j0, j1) on a target at (xi, yi) to (sx, sy) */
+        static void range_scalar(double xi, double yi, const double* x, const double* y,
+            int j0, int j1, double kuv2, double& sx, double& sy) {
+            for (int j = j0; j < j1; j++) {
+                double dx = xi - x[j], dy = yi - y[j], r2 = dx * dx + dy * dy,
+                    f = kuv2 / (r2 * sqrt(r2));
+                sx += f * dx;
+                sy += f * dy;
+            }
+        }
+
+#ifdef FD_SIMD_X86
+        FD_TARGET("sse2")
+        static void range_sse2(double xi, double yi, const double* x, const double* y,
+            int j0, int j1, double kuv2, double& sx, double& sy) {
+            __m128d vxi = _mm_set1_pd(xi), vyi = _mm_set1_pd(yi), k = _mm_set1_pd(kuv2),
+                acc_x = _mm_setzero_pd(), acc_y = _mm_setzero_pd();
+
+            int j = j0;
+            for (; j + 2 <= j1; j += 2) {
+                __m128d dx = _mm_sub_pd(vxi, _mm_loadu_pd(x + j)),
+                    dy = _mm_sub_pd(vyi, _mm_loadu_pd(y + j)),
+                    r2 = _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)),
+                    f = _mm_div_pd(k, _mm_mul_pd(r2, _mm_sqrt_pd(r2)));
+                acc_x = _mm_add_pd(acc_x, _mm_mul_pd(f, dx));
+                acc_y = _mm_add_pd(acc_y, _mm_mul_pd(f, dy));
+            }
+
+            double lanes_x[2], lanes_y[2];
+            _mm_storeu_pd(lanes_x, acc_x);
+            _mm_storeu_pd(lanes_y, acc_y);
+            sx += lanes_x[0] + lanes_x[1];
+            sy += lanes_y[0] + lanes_y[1];
+            range_scalar(xi, yi, x, y, j, j1, kuv2, sx, sy);
+        }
+
+        FD_TARGET("avx2")
+        static void range_avx2(double xi, double yi, const double* x, const double* y,
+            int j0, int j1, double kuv2, double& sx, double& sy) {
+            __m256d vxi = _mm256_set1_pd(xi), vyi = _mm256_set1_pd(yi), k = _mm256_set1_pd(kuv2),
+                acc_x = _mm256_setzero_pd(), acc_y = _mm256_setzero_pd();
+
+            int j = j0;
+            for (; j + 4 <= j1; j += 4) {
+                __m256d dx = _mm256_sub_pd(vxi, _mm256_loadu_pd(x + j)),
+                    dy = _mm256_sub_pd(vyi, _mm256_loadu_pd(y + j)),
+                    r2 = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)),
+                    f = _mm256_div_pd(k, _mm256_mul_pd(r2, _mm256_sqrt_pd(r2)));
+                acc_x = _mm256_add_pd(acc_x, _mm256_mul_pd(f, dx));
+                acc_y = _mm256_add_pd(acc_y, _mm256_mul_pd(f, dy));
+            }
+
+            double lanes_x[4], lanes_y[4];
+            _mm256_storeu_pd(lanes_x, acc_x);
+            _mm256_storeu_pd(lanes_y, acc_y);
+            sx += (lanes_x[0] + lanes_x[1]) + (lanes_x[2] + lanes_x[3]);
+            sy += (lanes_y[0] + lanes_y[1]) + (lanes_y[2] + lanes_y[3]);
+            range_scalar(xi, yi, x, y, j, j1, kuv2, sx, sy);
+        }
+
+        FD_TARGET("avx512f")
+        static void range_avx512(double xi, double yi, const double* x, const double* y,
+            int j0, int j1, double kuv2, double& sx, double& sy) {
+            __m512d vxi = _mm512_set1_pd(xi), vyi = _mm512_set1_pd(yi), k = _mm512_set1_pd(kuv2),
+                acc_x = _mm512_setzero_pd(), acc_y = _mm512_setzero_pd();
+
+            int j = j0;
+            for (; j + 8 <= j1; j += 8) {
+                __m512d dx = _mm512_sub_pd(vxi, _mm512_loadu_pd(x + j)),
+                    dy = _mm512_sub_pd(vyi, _mm512_loadu_pd(y + j)),
+                    r2 = _mm512_add_pd(_mm512_mul_pd(dx, dx), _mm512_mul_pd(dy, dy)),
+                    f = _mm512_div_pd(k, _mm512_mul_pd(r2, _mm512_sqrt_pd(r2)));
+                acc_x = _mm512_add_pd(acc_x, _mm512_mul_pd(f, dx));
+                acc_y = _mm512_add_pd(acc_y, _mm512_mul_pd(f, dy));
+            }
+
+            double lanes_x[8], lanes_y[8];
+            _mm512_storeu_pd(lanes_x, acc_x);
+            _mm512_storeu_pd(lanes_y, acc_y);
+            for (int l = 0; l < 8; l++) {
+                sx += lanes_x[l];
+                sy += lanes_y[l];
+            }
+
+            range_scalar(xi, yi, x, y, j, j1, kuv2, sx, sy);
+        }
+#endif
+
+        static Isa cpu_isa() {
+#if defined(FD_SIMD_X86) && defined(_MSC_VER) && !defined(__clang__)
+            int info[4];
+            __cpuid(info, 0);
+            const int max_leaf = info[0];
+
+            __cpuid(info, 1);
+            const bool osxsave = (info[2] & (1 << 27)) != 0,
+                avx = (info[2] & (1 << 28)) != 0;
+            const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+
+            if (max_leaf >= 7 && avx && (xcr0 & 0x6) == 0x6) {
+                __cpuidex(info, 7, 0);
+                if ((info[1] & (1 << 16)) && (xcr0 & 0xe6) == 0xe6) return Isa::AVX512;
+                if (info[1] & (1 << 5)) return Isa::AVX2;
+            }
+
+            return Isa::SSE2; // Always there on x64
+#elif defined(FD_SIMD_X86)
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f")) return Isa::AVX512;
+            if (__builtin_cpu_supports("avx2")) return Isa::AVX2;
+            if (__builtin_cpu_supports("sse2")) return Isa::SSE2;
+            return Isa::SCALAR;
+#else
+            return Isa::SCALAR;
+#endif
+        }
+
+        Isa detect() {
+            static const Isa isa = cpu_isa();
+            return isa;
+        }
+
+        const char* name(Isa isa) {
+            switch (isa) {
+            case Isa::SSE2: return "SSE2";
+            case Isa::AVX2: return "AVX2";
+            case Isa::AVX512: return "AVX-512";
+            default: return "scalar";
+            }
+        }
+
+        void repulsion(Isa isa, const double* x, const double* y, int n,
+            int begin, int end, double kuv2, double* fx, double* fy) {
+            auto range = range_scalar;
+#ifdef FD_SIMD_X86
+            // Never run an instruction set the CPU doesn't have
+            isa = std::min(isa, detect());
+            if (isa == Isa::SSE2) range = range_sse2;
+            else if (isa == Isa::AVX2) range = range_avx2;
+            else if (isa == Isa::AVX512) range = range_avx512;
+#endif
+
+            std::fill(fx + begin, fx + end, 0.0);
+            std::fill(fy + begin, fy + end, 0.0);
+
+            for (int j0 = 0; j0 < n; j0 += TILE) {
+                const int j1 = std::min(n, j0 + TILE);
+                for (int i = begin; i < end; i++) {
+                    // Skip i itself by splitting the tile around it
+                    range(x[i], y[i], x, y, j0, std::min(i, j1), kuv2, fx[i], fy[i]);
+                    range(x[i], y[i], x, y, std::max(i + 1, j0), j1, kuv2, fx[i], fy[i]);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,38 @@
+// Vectorized all-pairs electrical force for Eades' algorithm
+
+#pragma once
+
+namespace force_directed {
+    namespace simd {
+        enum class Isa {
+            SCALAR,
+            SSE2,  /** 2 doubles per instruction */
+            AVX2,  /** 4 doubles per instruction */
+            AVX512 /** 8 doubles per instruction */
+        };
+
+        /** Widest instruction set supported by both this build and this CPU
+         *  (detected once, on the first call)
+         */
+        Isa detect();
+        const char* name(Isa isa);
+
+        /** For every target i in [begin, end), set
+         *
+         *      fx[i], fy[i] = sum over j != i of kuv2 * (p_i - p_j) / |p_i - p_j|^3
+         *
+         *  over all n vertices. Sources are processed in tiles small enough to
+         *  stay in L1 cache while every target in the range sweeps over them.
+         *
+         *  Tolerance: every instruction set computes each term in double
+         *  precision as kuv2 / (r^2 sqrt(r^2)) times the offset. The scalar
+         *  loop in eades84_helper::calculate_force computes it differently,
+         *  as kuv2 / (d * d) * dx / d with d the distance, and adds the terms
+         *  in a different order. Each term differs by a few units in the last
+         *  place, so results agree to within about 1e-12 times the sum of the
+         *  magnitudes of the individual terms.
+         */
+        void repulsion(Isa isa, const double* x, const double* y, int n,
+            int begin, int end, double kuv2, double* fx, double* fy);
+    }
+}
@@ -0,0 +1,138 @@
+#include "force_directed.h"
+#include "mapped_file.h"
+#include <algorithm>
+#include <string.h>
+
+namespace force_directed {
+    static const char SNAPSHOT_MAGIC[8] = "FDSNAP";
+
+    static uint64_t mix(uint64_t z) {
+        // splitmix64 finalizer
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    static size_t ids_bytes(uint64_t vertices) {
+        return (size_t)(4 * vertices + 7) / 8 * 8;
+    }
+
+    uint64_t graph_hash(TUNGraph& graph) {
+        /** Hash of the vertex ids and edges of graph, which doesn't depend on
+         *  the order they were added in (a sum of hashes of each)
+         */
+        uint64_t hash = mix(graph.GetNodes()) ^ mix(~(uint64_t)graph.GetEdges());
+        for (auto node = graph.BegNI(); node < graph.EndNI(); node++)
+            hash += mix((uint32_t)node.GetId());
+
+        for (auto edge = graph.BegEI(); edge < graph.EndEI(); edge++) {
+            const uint32_t u = std::min(edge.GetSrcNId(), edge.GetDstNId()),
+                v = std::max(edge.GetSrcNId(), edge.GetDstNId());
+            hash += mix(((uint64_t)u << 32 | v) ^ 0x9e3779b97f4a7c15ULL);
+        }
+
+        return hash;
+    }
+
+    template<typename Float>
+    static void write_coordinates(std::ofstream& out, const std::vector<double>& values) {
+        const size_t BLOCK = 1 << 16;
+        std::vector<Float> buffer;
+        for (size_t begin = 0; begin < values.size(); begin += BLOCK) {
+            const size_t end = std::min(values.size(), begin + BLOCK);
+            buffer.assign(values.begin() + begin, values.begin() + end);
+            out.write((const char*)buffer.data(), buffer.size() * sizeof(Float));
+        }
+    }
+
+    void write_snapshot(const std::string& file, TUNGraph& graph, const LayoutState& state,
+        long long iteration, int width) {
+        /** Save the positions in state as a layout snapshot of graph, with
+         *  coordinates stored as float64 (width = 8) or float32 (width = 4)
+         */
+        if (width != 4 && width != 8) throw std::runtime_error("Coordinates must be 4 or 8 bytes wide");
+        if (!little_endian_host()) throw std::runtime_error("Layout snapshots need a little-endian machine");
+
+        std::ofstream out(file, std::ios::binary);
+        if (!out) throw std::runtime_error("Could not open " + file);
+
+        SnapshotHeader header = {};
+        memcpy(header.magic, SNAPSHOT_MAGIC, sizeof header.magic);
+        header.version = 1;
+        header.width = (uint32_t)width;
+        header.vertices = (uint64_t)state.size();
+        header.graph_hash = graph_hash(graph);
+        header.iteration = iteration;
+        out.write((const char*)&header, sizeof header);
+
+        std::vector<int32_t> ids(ids_bytes(header.vertices) / 4, 0);
+        std::copy(state.ids.begin(), state.ids.end(), ids.begin());
+        out.write((const char*)ids.data(), ids.size() * sizeof(int32_t));
+
+        if (width == 8) {
+            write_coordinates<double>(out, state.x);
+            write_coordinates<double>(out, state.y);
+        }
+        else {
+            write_coordinates<float>(out, state.x);
+            write_coordinates<float>(out, state.y);
+        }
+
+        if (!out) throw std::runtime_error("Could not write " + file);
+    }
+
+    bool is_snapshot(const std::string& file) {
+        /** Whether file starts like a layout snapshot (as opposed to a CSV) */
+        std::ifstream in(file, std::ios::binary);
+        char magic[sizeof SNAPSHOT_MAGIC] = {};
+        in.read(magic, sizeof magic);
+        return in && memcmp(magic, SNAPSHOT_MAGIC, sizeof magic) == 0;
+    }
+
+    template<typename Float>
+    static void read_coordinates(const SnapshotHeader& header, const int32_t* ids,
+        const char* body, VertexPos& pos) {
+        const size_t n = (size_t)header.vertices;
+        const Float* x = (const Float*)body, *y = x + n;
+        for (size_t i = 0; i < n; i++) pos[ids[i]] = std::make_pair((double)x[i], (double)y[i]);
+    }
+
+    SnapshotHeader read_snapshot(const std::string& file, VertexPos& pos) {
+        /** Read a layout snapshot into pos, which is memory mapped and read in
+         *  place. The header is returned so the graph hash and iteration can
+         *  be checked.
+         */
+        if (!little_endian_host()) throw std::runtime_error("Layout snapshots need a little-endian machine");
+
+        MappedFile mapped(file);
+        SnapshotHeader header;
+        if (mapped.size() < sizeof header) throw std::runtime_error(file + " is too short to be a layout snapshot");
+
+        memcpy(&header, mapped.data(), sizeof header);
+        if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof header.magic) != 0)
+            throw std::runtime_error(file + " is not a layout snapshot");
+        if (header.version != 1)
+            throw std::runtime_error(file + " has unsupported snapshot version " + std::to_string(header.version));
+        if (header.width != 4 && header.width != 8)
+            throw std::runtime_error(file + " has unsupported coordinate width " + std::to_string(header.width));
+
+        // Every vertex takes at least 4 bytes, which bounds the count before
+        // it is multiplied, so a corrupt header can't overflow the size check
+        if (header.vertices > mapped.size() / 4)
+            throw std::runtime_error(file + " should hold " + std::to_string(header.vertices) +
+                " vertices but is too short");
+
+        const size_t ids_size = ids_bytes(header.vertices);
+        if (mapped.size() != sizeof header + ids_size + 2 * (size_t)header.width * (size_t)header.vertices)
+            throw std::runtime_error(file + " should hold " + std::to_string(header.vertices) +
+                " vertices but has the wrong size");
+
+        // Every section starts 8 byte aligned, so it can be read in place
+        const int32_t* ids = (const int32_t*)(mapped.data() + sizeof header);
+        const char* body = mapped.data() + sizeof header + ids_size;
+        if (header.width == 8) read_coordinates<double>(header, ids, body, pos);
+        else read_coordinates<float>(header, ids, body, pos);
+
+        return header;
+    }
+}
@@ -0,0 +1,309 @@
+#include "force_directed.h"
+#include <algorithm>
+
+namespace force_directed {
+    namespace spectral_helper {
+        Laplacian laplacian(const CSRAdjacency& adjacent) {
+            /** L = D - A, one row per vertex */
+            const int n = adjacent.size();
+            std::vector<Eigen::Triplet<double>> triplets;
+            triplets.reserve(adjacent.neighbors.size() + n);
+
+            for (int u = 0; u < n; u++) {
+                triplets.emplace_back(u, u, adjacent.degree(u));
+                for (auto v = adjacent.begin(u); v != adjacent.end(u); v++)
+                    triplets.emplace_back(u, *v, -1.0);
+            }
+
+            Laplacian l(n, n);
+            l.setFromTriplets(triplets.begin(), triplets.end());
+            return l;
+        }
+
+        static void orthonormalize(Block& x, const VectorXd& d, std::mt19937& generator) {
+            /** Make the columns of x orthonormal to each other and to the
+             *  constant vector under the inner product <u, v> = u^T D v
+             */
+            const double total = d.sum();
+            std::normal_distribution<double> normal;
+
+            for (int j = 0; j < BLOCK; j++) {
+                for (int pass = 0; pass < 2; pass++) { // Twice is enough (Giraud et al. 2005)
+                    x.col(j).array() -= x.col(j).dot(d) / total;
+                    for (int i = 0; i < j; i++)
+                        x.col(j) -= x.col(i).cwiseProduct(d).dot(x.col(j)) * x.col(i);
+                }
+
+                double norm = sqrt(x.col(j).cwiseProduct(d).dot(x.col(j)));
+                if (norm < 1e-12) {
+                    // Lost this direction: restart it from noise
+                    for (int v = 0; v < x.rows(); v++) x(v, j) = normal(generator);
+                    j--;
+                    continue;
+                }
+
+                x.col(j) /= norm;
+            }
+        }
+
+        int eigenvectors(const Laplacian& laplacian, Block& x, double tolerance,
+            int max_iterations, std::mt19937& generator) {
+            /** Refine x toward the eigenvectors of L x = lambda D x with the
+             *  smallest nonzero eigenvalues, as in Koren (2005). This is
+             *  orthogonal iteration with Rayleigh-Ritz on M = I - D^-1 L / 2, whose
+             *  largest eigenvalues are 1 (constant vector, projected out),
+             *  then 1 - lambda_2 / 2, and so on. The columns of x past the
+             *  first two only speed up convergence of the first two.
+             *
+             *  Returns the number of iterations, stopping once the residual of
+             *  both coordinates is below tolerance.
+             */
+            const int n = (int)laplacian.rows();
+            VectorXd d(n);
+            for (int v = 0; v < n; v++) d(v) = std::max(laplacian.coeff(v, v), 1.0);
+
+            orthonormalize(x, d, generator);
+            Block z(n, BLOCK);
+
+            int it = 0;
+            while (it < max_iterations) {
+                it++;
+
+                // z = M x, one row at a time
+                #pragma omp parallel for schedule(static)
+                for (int u = 0; u < n; u++) {
+                    Eigen::Matrix<double, 1, BLOCK> lx = Eigen::Matrix<double, 1, BLOCK>::Zero();
+                    for (Laplacian::InnerIterator entry(laplacian, u); entry; ++entry)
+                        lx += entry.value() * x.row(entry.col());
+                    z.row(u) = x.row(u) - (0.5 / d(u)) * lx;
+                }
+
+                // Rayleigh-Ritz: rotate the block onto the eigenvectors of x^T D M x,
+                // largest first
+                MatrixXd h = x.transpose() * d.asDiagonal() * z;
+                Eigen::SelfAdjointEigenSolver<MatrixXd> ritz((h + h.transpose()) / 2);
+                MatrixXd rotate = ritz.eigenvectors().rowwise().reverse();
+                VectorXd mu = ritz.eigenvalues().reverse();
+
+                Block rotated = x * rotate;
+                x = z * rotate;
+
+                // Residual M v - mu v of the two coordinates
+                double residual = 0;
+                for (int j = 0; j < 2; j++) {
+                    VectorXd r = x.col(j) - mu(j) * rotated.col(j);
+                    residual = std::max(residual, sqrt(r.cwiseProduct(d).dot(r)));
+                }
+
+                orthonormalize(x, d, generator);
+                if (residual < tolerance) break;
+            }
+
+            return it;
+        }
+
+        static void connected_layout(SpectralParams& params, const CSRAdjacency& adjacent,
+            LayoutState& state, std::mt19937& generator) {
+            /** Set the positions in state (indexed like adjacent) to a layout of
+             *  one connected graph by the two eigenvectors of its Laplacian with
+             *  the smallest nonzero eigenvalues, scaled so the mean edge is
+             *  params.edge_length long.
+             *
+             *  Eigenvectors of large graphs are found on a hierarchy of coarsened
+             *  graphs (Koren, Carmel and Harel 2002): solved exactly on the
+             *  coarsest graph, then interpolated to each finer graph and refined by
+             *  eigenvectors(). Refinement rarely takes more than a few dozen
+             *  iterations per level, each costing O(m).
+             */
+            const int DENSE_VERTICES = 256; // Solve directly at or below this size
+
+            // Too small to have two nonzero eigenvalues: a point or an edge
+            if (adjacent.size() < 3) {
+                for (int v = 0; v < adjacent.size(); v++) {
+                    state.x[v] = v * params.edge_length;
+                    state.y[v] = 0;
+                }
+
+                return;
+            }
+
+            std::vector<CSRAdjacency> levels;
+            std::vector<std::vector<int>> parents; // parents[l] maps level l to level l + 1
+            levels.push_back(adjacent);
+
+            while (levels.back().size() > DENSE_VERTICES) {
+                std::vector<int> parent;
+                CSRAdjacency coarse = multilevel_helper::coarsen(levels.back(), parent, generator);
+                if (coarse.size() > 0.9 * levels.back().size()) break; // Matchings stopped helping
+
+                parents.push_back(std::move(parent));
+                levels.push_back(std::move(coarse));
+            }
+
+            // Coarsest level
+            int l = (int)levels.size() - 1;
+            const int coarsest = levels[l].size();
+            Laplacian lap = laplacian(levels[l]);
+            Block x = Block::Zero(coarsest, BLOCK);
+
+            if (coarsest <= DENSE_VERTICES) {
+                MatrixXd dense = MatrixXd(lap);
+                MatrixXd d = MatrixXd::Zero(coarsest, coarsest);
+                for (int v = 0; v < coarsest; v++) d(v, v) = std::max(dense(v, v), 1.0);
+
+                Eigen::GeneralizedSelfAdjointEigenSolver<MatrixXd> exact(dense, d);
+                for (int j = 0; j < BLOCK && j + 1 < coarsest; j++)
+                    x.col(j) = exact.eigenvectors().col(j + 1);
+            }
+            else {
+                std::normal_distribution<double> normal;
+                for (int v = 0; v < coarsest; v++)
+                    for (int j = 0; j < BLOCK; j++) x(v, j) = normal(generator);
+
+                eigenvectors(lap, x, params.tolerance, params.max_iterations, generator);
+            }
+
+            // Interpolate and refine
+            for (l--; l >= 0; l--) {
+                const std::vector<int>& parent = parents[l];
+                Block fine(levels[l].size(), BLOCK);
+                for (int u = 0; u < fine.rows(); u++) fine.row(u) = x.row(parent[u]);
+
+                x = std::move(fine);
+                eigenvectors(laplacian(levels[l]), x, params.tolerance, params.max_iterations, generator);
+            }
+
+            for (int v = 0; v < state.size(); v++) {
+                state.x[v] = x(v, 0);
+                state.y[v] = x(v, 1);
+            }
+
+            scale_edge_length(state, levels[0], params.edge_length);
+        }
+
+        static int components(const CSRAdjacency& adjacent, std::vector<int>& component) {
+            /** Set component[v] to the index of v's connected component, numbered
+             *  in order of their first vertex, and return how many there are
+             */
+            const int n = adjacent.size();
+            component.assign(n, -1);
+            std::vector<int> stack;
+
+            int count = 0;
+            for (int s = 0; s < n; s++) {
+                if (component[s] >= 0) continue;
+
+                component[s] = count;
+                stack.push_back(s);
+                while (!stack.empty()) {
+                    int u = stack.back();
+                    stack.pop_back();
+                    for (auto v = adjacent.begin(u); v != adjacent.end(u); v++) {
+                        if (component[*v] < 0) {
+                            component[*v] = count;
+                            stack.push_back(*v);
+                        }
+                    }
+                }
+
+                count++;
+            }
+
+            return count;
+        }
+    }
+
+    VertexPos spectral_layout(SpectralParams& params, TUNGraph& graph) {
+        /** Lay out a graph using the two eigenvectors of its Laplacian with the
+         *  smallest nonzero eigenvalues, scaled so the mean edge is
+         *  params.edge_length long. Every connected component has its own zero
+         *  eigenvalue, so the components are laid out separately and then
+         *  packed in rows, largest first, params.edge_length apart.
+         */
+        using namespace spectral_helper;
+
+        LayoutState state(graph);
+        std::mt19937 generator(params.seed);
+        if (state.size() < 3) return random_layout(graph, params.seed);
+
+        CSRAdjacency adjacent(graph, state);
+        std::vector<int> component;
+        const int k = components(adjacent, component);
+        if (k == 1) {
+            connected_layout(params, adjacent, state, generator);
+            return state.to_pos();
+        }
+
+        // Group vertices by component (counting sort)
+        const int n = state.size();
+        std::vector<int> first(k + 1, 0), members(n), local(n);
+        for (int v = 0; v < n; v++) first[component[v] + 1]++;
+        for (int c = 0; c < k; c++) first[c + 1] += first[c];
+
+        std::vector<int> fill(first.begin(), first.end() - 1);
+        for (int v = 0; v < n; v++) {
+            local[v] = fill[component[v]] - first[component[v]];
+            members[fill[component[v]]++] = v;
+        }
+
+        // Lay out each component at the origin, and find its bounding box
+        struct Box { double min_x, min_y, width, height; };
+        std::vector<Box> boxes(k);
+        double area = 0;
+
+        for (int c = 0; c < k; c++) {
+            const int size = first[c + 1] - first[c];
+            CSRAdjacency sub;
+            sub.offsets.reserve(size + 1);
+            sub.offsets.push_back(0);
+            for (int m = first[c]; m < first[c + 1]; m++) {
+                const int u = members[m];
+                for (auto v = adjacent.begin(u); v != adjacent.end(u); v++) sub.neighbors.push_back(local[*v]);
+                sub.offsets.push_back((int)sub.neighbors.size());
+            }
+
+            LayoutState piece(size);
+            connected_layout(params, sub, piece, generator);
+
+            Box& box = boxes[c];
+            box.min_x = *std::min_element(piece.x.begin(), piece.x.end());
+            box.min_y = *std::min_element(piece.y.begin(), piece.y.end());
+            box.width = *std::max_element(piece.x.begin(), piece.x.end()) - box.min_x;
+            box.height = *std::max_element(piece.y.begin(), piece.y.end()) - box.min_y;
+            area += (box.width + params.edge_length) * (box.height + params.edge_length);
+
+            for (int m = first[c]; m < first[c + 1]; m++) {
+                state.x[members[m]] = piece.x[local[members[m]]];
+                state.y[members[m]] = piece.y[local[members[m]]];
+            }
+        }
+
+        // Shelf packing, tallest first, into rows about as wide as the result is tall
+        std::vector<int> order(k);
+        for (int c = 0; c < k; c++) order[c] = c;
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+            return boxes[a].height > boxes[b].height;
+        });
+
+        const double row_width = sqrt(area), gap = params.edge_length;
+        double cursor_x = 0, cursor_y = 0, row_height = 0;
+        for (int c : order) {
+            const Box& box = boxes[c];
+            if (cursor_x > 0 && cursor_x + box.width > row_width) {
+                cursor_x = 0;
+                cursor_y += row_height + gap;
+                row_height = 0;
+            }
+
+            for (int m = first[c]; m < first[c + 1]; m++) {
+                state.x[members[m]] += cursor_x - box.min_x;
+                state.y[members[m]] += cursor_y - box.min_y;
+            }
+
+            cursor_x += box.width + gap;
+            row_height = std::max(row_height, box.height);
+        }
+
+        return state.to_pos();
+    }
+}
@@ -0,0 +1,267 @@
+#include "force_directed.h"
+#include <algorithm>
+#include <limits>
+
+namespace force_directed {
+    namespace stress_helper {
+        void bfs(const CSRAdjacency& adjacent, int source, std::vector<int>& dist) {
+            /** Set dist[v] to the number of hops from source to v, or -1 if
+             *  v can't be reached
+             */
+            const int n = adjacent.size();
+            dist.assign(n, -1);
+            std::vector<int> queue(n);
+            int head = 0, tail = 0;
+
+            dist[source] = 0;
+            queue[tail++] = source;
+            while (head < tail) {
+                int u = queue[head++];
+                for (auto v = adjacent.begin(u); v != adjacent.end(u); v++) {
+                    if (dist[*v] < 0) {
+                        dist[*v] = dist[u] + 1;
+                        queue[tail++] = *v;
+                    }
+                }
+            }
+        }
+
+        std::vector<int> maxmin_pivots(const CSRAdjacency& adjacent, int k, unsigned seed,
+            std::vector<std::vector<int>>& dist) {
+            /** Pick k pivots, each as far as possible from the ones before it
+             *  (the first is random), and set dist[p] to the hops from pivot p
+             *  to every vertex
+             */
+            const int n = adjacent.size();
+            std::mt19937 generator(seed);
+            std::vector<int> pivots, closest(n, std::numeric_limits<int>::max());
+            dist.assign(k, {});
+            if (n == 0) return pivots;
+
+            int next = std::uniform_int_distribution<int>(0, n - 1)(generator);
+            for (int p = 0; p < k; p++) {
+                pivots.push_back(next);
+                bfs(adjacent, next, dist[p]);
+
+                for (int v = 0; v < n; v++)
+                    if (dist[p][v] >= 0) closest[v] = std::min(closest[v], dist[p][v]);
+
+                // Unreachable vertices (closest = max) are picked first
+                next = (int)(std::max_element(closest.begin(), closest.end()) - closest.begin());
+            }
+
+            return pivots;
+        }
+
+        std::vector<Term> sparse_terms(StressParams& params, const CSRAdjacency& adjacent) {
+            /** Sparse stress model after Ortmann, Klimenta and Brandes (2016).
+             *  Every pair of vertices within params.hops of each other is a term
+             *  with weight 1 / d^2. Pairs further apart are replaced by terms
+             *  between each vertex and the pivots: pivot p stands in for every
+             *  vertex closer to p than any other pivot, so its term with
+             *  vertex i is weighted by how many of those lie within half of
+             *  d(i, p) of p.
+             *
+             *  Unlike in the paper, where a pivot term only moves vertex i, the
+             *  terms are symmetric, so that stress_layout() can solve with one
+             *  fixed Laplacian: each pivot is also pulled by its terms with
+             *  every vertex further than params.hops away. Two such pivots
+             *  share one term, weighted by the mean of their two weights.
+             */
+            const int n = adjacent.size(), k = std::min(params.pivots, n);
+            const double L = params.edge_length;
+            if (n < 2) return {};
+
+            std::vector<std::vector<int>> pivot_dist;
+            std::vector<int> pivots = maxmin_pivots(adjacent, k, params.seed, pivot_dist);
+
+            // Assign every vertex to its closest pivot
+            std::vector<int> nearest(n, -1), closest(n, std::numeric_limits<int>::max());
+            for (int p = 0; p < k; p++) {
+                for (int v = 0; v < n; v++) {
+                    int d = pivot_dist[p][v];
+                    if (d >= 0 && d < closest[v]) {
+                        closest[v] = d;
+                        nearest[v] = p;
+                    }
+                }
+            }
+
+            std::vector<int> pivot_of(n, -1); // Which pivot each vertex is, if any
+            for (int p = 0; p < k; p++) pivot_of[pivots[p]] = p;
+
+            // Distances from each pivot to the vertices it stands in for, sorted
+            std::vector<std::vector<int>> region(k);
+            for (int v = 0; v < n; v++)
+                if (nearest[v] >= 0) region[nearest[v]].push_back(closest[v]);
+            for (auto& r : region) std::sort(r.begin(), r.end());
+
+            // How many vertices pivot p stands in for in a term hops away
+            auto stands_in = [&](int p, int hops) {
+                auto& r = region[p];
+                return (double)(std::upper_bound(r.begin(), r.end(), hops / 2) - r.begin());
+            };
+
+            // Collect each vertex's terms separately, then concatenate them in
+            // vertex order so the result doesn't depend on the thread count
+            std::vector<std::vector<Term>> local(n);
+
+            #pragma omp parallel
+            {
+                std::vector<int> dist(n, -1), visited;
+
+                #pragma omp for schedule(dynamic, 64)
+                for (int i = 0; i < n; i++) {
+                    // Neighborhood: breadth first search cut off at params.hops
+                    visited.assign(1, i);
+                    dist[i] = 0;
+                    for (size_t head = 0; head < visited.size(); head++) {
+                        int u = visited[head];
+                        if (dist[u] >= params.hops) continue;
+
+                        for (auto v = adjacent.begin(u); v != adjacent.end(u); v++) {
+                            if (dist[*v] < 0) {
+                                dist[*v] = dist[u] + 1;
+                                visited.push_back(*v);
+                            }
+                        }
+                    }
+
+                    for (int v : visited) {
+                        if (v > i) {
+                            double d = dist[v] * L;
+                            local[i].push_back({ i, v, d, 1 / (d * d) });
+                        }
+                    }
+
+                    // Pivots outside the neighborhood
+                    const int q = pivot_of[i];
+                    for (int p = 0; p < k; p++) {
+                        int hops = pivot_dist[p][i];
+                        if (hops <= params.hops) continue; // Unreachable, or already a term
+                        if (q >= 0 && q > p) continue;     // Made from the other pivot
+
+                        double s = stands_in(p, hops), d = hops * L;
+                        if (q >= 0) s = (s + stands_in(q, hops)) / 2;
+                        local[i].push_back({ i, pivots[p], d, s / (d * d) });
+                    }
+
+                    for (int v : visited) dist[v] = -1;
+                }
+            }
+
+            std::vector<Term> terms;
+            for (auto& l : local) terms.insert(terms.end(), l.begin(), l.end());
+            return terms;
+        }
+
+        double stress(const std::vector<Term>& terms, const LayoutState& state) {
+            /** Sum of w * (|p_i - p_j| - d)^2 over the terms */
+            double sum = 0;
+            for (auto& t : terms) {
+                double diff = std::hypot(state.x[t.i] - state.x[t.j], state.y[t.i] - state.y[t.j]) - t.d;
+                sum += t.w * diff * diff;
+            }
+
+            return sum;
+        }
+    }
+
+    std::vector<SVG::SVG> stress_layout(StressParams& params, TUNGraph& graph, VertexPos& pos) {
+        /** Stress majorization, creating a frame between each iteration */
+        std::vector<SVG::SVG> ret;
+        stress_layout(params, graph, pos, [&](const LayoutState& state, int) {
+            ret.push_back(draw_graph(graph, state));
+        });
+
+        return ret;
+    }
+
+    void stress_layout(StressParams& params, TUNGraph& graph, VertexPos& pos,
+        const FrameCallback& callback, const FrameOptions& options) {
+        /** Lay out a graph so that the distance between every pair of
+         *  vertices approximates their graph-theoretic distance times
+         *  params.edge_length, by stress majorization (SMACOF) over the
+         *  sparse terms from stress_helper::sparse_terms()
+         *
+         *  Every iteration solves L_w x = L_Z(x) x for x and y, where L_w is the
+         *  Laplacian of the weights. L_w doesn't change, so it is factored once.
+         */
+        using namespace stress_helper;
+        using SparseMatrix = Eigen::SparseMatrix<double>;
+
+        LayoutState state(graph, pos);
+        CSRAdjacency adjacent(graph, state);
+        FrameRecorder frames(callback, options);
+        frames.record(state, 0);
+
+        const int n = state.size();
+        auto terms = sparse_terms(params, adjacent);
+        if (terms.empty()) {
+            frames.finish(state, 0);
+            return;
+        }
+
+        // Weighted Laplacian, plus a small multiple of the identity pulling every
+        // vertex toward where it was, so that it is still invertible when the
+        // graph isn't connected
+        std::vector<Eigen::Triplet<double>> triplets;
+        std::vector<double> diagonal(n, 0);
+        for (auto& t : terms) {
+            triplets.emplace_back(t.i, t.j, -t.w);
+            triplets.emplace_back(t.j, t.i, -t.w);
+            diagonal[t.i] += t.w;
+            diagonal[t.j] += t.w;
+        }
+
+        double mean = 0;
+        for (double d : diagonal) mean += d / n;
+        const double eps = 1e-6 * mean;
+        for (int i = 0; i < n; i++) triplets.emplace_back(i, i, diagonal[i] + eps);
+
+        SparseMatrix lw(n, n);
+        lw.setFromTriplets(triplets.begin(), triplets.end());
+        Eigen::SimplicialLDLT<SparseMatrix> solver(lw);
+        if (solver.info() != Eigen::Success) throw std::runtime_error("Failed to factor stress Laplacian");
+
+        VectorXd bx(n), by(n);
+        double current = stress(terms, state);
+
+        bool move = true;
+        int i = 0;
+        for (; move && i < params.max_iterations; i++) {
+            for (int v = 0; v < n; v++) {
+                bx(v) = eps * state.x[v];
+                by(v) = eps * state.y[v];
+            }
+
+            for (auto& t : terms) {
+                double dx = state.x[t.i] - state.x[t.j], dy = state.y[t.i] - state.y[t.j],
+                    dist = std::hypot(dx, dy);
+                if (dist == 0) continue;
+
+                double delta = t.w * t.d / dist;
+                bx(t.i) += delta * dx;
+                by(t.i) += delta * dy;
+                bx(t.j) -= delta * dx;
+                by(t.j) -= delta * dy;
+            }
+
+            VectorXd x = solver.solve(bx), y = solver.solve(by);
+            for (int v = 0; v < n; v++) {
+                state.x[v] = x(v);
+                state.y[v] = y(v);
+            }
+
+            frames.record(state, i + 1);
+
+            // Majorization never increases stress, so stop once it levels off
+            double updated = stress(terms, state);
+            move = current - updated > params.tolerance * current;
+            current = updated;
+        }
+
+        frames.finish(state, i);
+        state.store(pos);
+    }
+}
@@ -0,0 +1,295 @@
+#include "force_directed.h"
+#include <algorithm>
+#include <ostream>
+#include <stdio.h>
+
+namespace force_directed {
+    namespace {
+    class SVGBuffer {
+        /** Buffers SVG text and passes it on to a stream in large blocks */
+    public:
+        explicit SVGBuffer(std::ostream& out) : out(out) { text.reserve(BLOCK + 256); }
+        ~SVGBuffer() { flush(); }
+
+        SVGBuffer& operator<<(const char* s) {
+            text += s;
+            if (text.size() >= BLOCK) flush();
+            return *this;
+        }
+
+        SVGBuffer& operator<<(double value) {
+            /** The digits std::to_string() (printf's %f) gives, as the SVG
+             *  library uses for attributes. Ordinary coordinates don't go
+             *  through printf: only huge values, and ones so close to halfway
+             *  between two outputs that scaling by 1e6 could round them the
+             *  other way, are left to it.
+             */
+            const double magnitude = std::abs(value), shifted = magnitude * 1e6;
+            if (!(magnitude < 1e7) || std::abs(shifted - std::floor(shifted) - 0.5) < 0.01) {
+                char number[512];
+                snprintf(number, sizeof number, "%f", value);
+                return *this << number;
+            }
+
+            long long scaled = std::llround(shifted);
+            if (value < 0 && scaled > 0) text += '-';
+            else if (std::signbit(value) && scaled == 0) text += '-'; // printf keeps -0.000000
+
+            char digits[32];
+            int length = 0;
+            for (int d = 0; d < 7 || scaled > 0; d++) {
+                if (d == 6) digits[length++] = '.';
+                digits[length++] = (char)('0' + scaled % 10);
+                scaled /= 10;
+            }
+
+            while (length > 0) text += digits[--length];
+            return *this;
+        }
+
+        void flush() {
+            out.write(text.data(), text.size());
+            text.clear();
+        }
+
+    private:
+        std::ostream& out;
+        std::string text;
+        static const size_t BLOCK = 1 << 20;
+    };
+    }
+
+    constexpr double ViewBox::MARGIN;
+
+    ViewBox::ViewBox(const LayoutState& state, const double width) : ViewBox(width) {
+        for (int i = 0; i < state.size(); i++) add(state.x[i], state.y[i]);
+    }
+
+    void ViewBox::add(double x, double y) {
+        if (empty) {
+            min_x = max_x = x;
+            min_y = max_y = y;
+            empty = false;
+        }
+
+        min_x = std::min(min_x, x);
+        max_x = std::max(max_x, x);
+        min_y = std::min(min_y, y);
+        max_y = std::max(max_y, y);
+    }
+
+    void write_svg(std::ostream& out, TUNGraph& graph, const LayoutState& state, const double width) {
+        /** Write the same drawing as draw_graph() followed by autoscale() to out,
+         *  one element at a time, without building the SVG document in memory
+         */
+        const ViewBox box(state, width);
+        const double min_x = box.left(), min_y = box.top(), max_x = box.right(), max_y = box.bottom();
+        const int n = state.size();
+
+        SVGBuffer svg(out);
+        svg << "<svg height=\"" << max_y - min_y << "\" viewBox=\"" << min_x << " " << min_y << " "
+            << max_x - min_x << " " << max_y - min_y << "\" width=\"" << max_x - min_x
+            << "\" xmlns=\"http://www.w3.org/2000/svg\">\n";
+
+        svg << "\t<g stroke=\"black\" stroke-width=\"1px\">\n";
+        for (auto edge = graph.BegEI(); edge < graph.EndEI(); edge++) {
+            int u = state.index.at(edge.GetSrcNId()), v = state.index.at(edge.GetDstNId());
+            svg << "\t\t<line x1=\"" << state.x[u] << "\" x2=\"" << state.x[v]
+                << "\" y1=\"" << state.y[u] << "\" y2=\"" << state.y[v] << "\" />\n";
+        }
+
+        svg << "\t</g>\n\t<g>\n";
+        for (int i = 0; i < n; i++) {
+            svg << "\t\t<circle cx=\"" << state.x[i] << "\" cy=\"" << state.y[i]
+                << "\" r=\"" << box.radius << "\" />\n";
+        }
+
+        svg << "\t</g>\n</svg>";
+    }
+
+    SMILAnimation::SMILAnimation(TUNGraph& graph, const double width, const double tolerance) :
+        tolerance(tolerance), box(width) {
+        LayoutState state(graph);
+        keyframes.resize(state.size());
+        pending.assign(state.size(), Keyframe{ -1, 0, 0 });
+
+        edges.reserve(graph.GetEdges());
+        for (auto edge = graph.BegEI(); edge < graph.EndEI(); edge++)
+            edges.push_back(std::make_pair(state.index.at(edge.GetSrcNId()), state.index.at(edge.GetDstNId())));
+    }
+
+    void SMILAnimation::add_frame(const LayoutState& state) {
+        /** Add the positions of state as the next frame */
+        if (state.size() != (int)keyframes.size())
+            throw std::runtime_error("Frame has " + std::to_string(state.size()) + " vertices, expected " +
+                std::to_string(keyframes.size()));
+
+        for (int i = 0; i < state.size(); i++) {
+            const Keyframe now = { n_frames, state.x[i], state.y[i] };
+            auto& kept = keyframes[i];
+
+            if (!kept.empty() && std::max(std::abs(now.x - kept.back().x), std::abs(now.y - kept.back().y)) <= tolerance) {
+                // Still near the last keyframe: only the end of the run is needed
+                pending[i] = now;
+                continue;
+            }
+
+            if (pending[i].frame >= 0) {
+                kept.push_back(pending[i]);
+                box.add(pending[i].x, pending[i].y);
+            }
+
+            kept.push_back(now);
+            pending[i].frame = -1;
+            box.add(now.x, now.y);
+        }
+
+        n_frames++;
+    }
+
+    void SMILAnimation::write(std::ostream& out, const double fps) const {
+        /** Write the animation, fps frames a second and looping, to out. The
+         *  viewBox holds every frame, with the same margin as write_svg().
+         */
+        if (n_frames == 0) throw std::runtime_error("An animation needs at least one frame");
+
+        const ViewBox box = view_box();
+        const double left = box.left(), top = box.top(),
+            width = box.right() - box.left(), height = box.bottom() - box.top();
+
+        SVGBuffer svg(out);
+        const double duration = n_frames / fps;
+        auto animate = [&](const char* attribute, int i, bool x) {
+            // The kept keyframes, then the pending one, then the last frame
+            // again at the end so it is shown as long as the others
+            const Keyframe& last = pending[i].frame >= 0 ? pending[i] : keyframes[i].back();
+            svg << "<animate attributeName=\"" << attribute << "\" dur=\"" << duration
+                << "s\" repeatCount=\"indefinite\" keyTimes=\"";
+            for (auto& key : keyframes[i]) svg << (double)key.frame / n_frames << ";";
+            if (pending[i].frame >= 0) svg << (double)pending[i].frame / n_frames << ";";
+            svg << "1\" values=\"";
+            for (auto& key : keyframes[i]) svg << (x ? key.x : key.y) << ";";
+            if (pending[i].frame >= 0) svg << (x ? pending[i].x : pending[i].y) << ";";
+            svg << (x ? last.x : last.y) << "\" />";
+        };
+
+        // Vertices which never left the tolerance of their first position are drawn there
+        auto moves = [&](int i) { return keyframes[i].size() > 1; };
+
+        svg << "<svg height=\"" << height << "\" viewBox=\"" << left << " " << top << " "
+            << width << " " << height << "\" width=\"" << width
+            << "\" xmlns=\"http://www.w3.org/2000/svg\">\n";
+
+        svg << "\t<g stroke=\"black\" stroke-width=\"1px\">\n";
+        for (auto& edge : edges) {
+            const int u = edge.first, v = edge.second;
+            svg << "\t\t<line x1=\"" << keyframes[u][0].x << "\" x2=\"" << keyframes[v][0].x
+                << "\" y1=\"" << keyframes[u][0].y << "\" y2=\"" << keyframes[v][0].y << "\"";
+            if (!moves(u) && !moves(v)) {
+                svg << " />\n";
+                continue;
+            }
+
+            svg << ">";
+            if (moves(u)) {
+                animate("x1", u, true);
+                animate("y1", u, false);
+            }
+            if (moves(v)) {
+                animate("x2", v, true);
+                animate("y2", v, false);
+            }
+            svg << "</line>\n";
+        }
+
+        svg << "\t</g>\n\t<g>\n";
+        for (int i = 0; i < (int)keyframes.size(); i++) {
+            svg << "\t\t<circle cx=\"" << keyframes[i][0].x << "\" cy=\"" << keyframes[i][0].y
+                << "\" r=\"" << box.radius << "\"";
+            if (!moves(i)) {
+                svg << " />\n";
+                continue;
+            }
+
+            svg << ">";
+            animate("cx", i, true);
+            animate("cy", i, false);
+            svg << "</circle>\n";
+        }
+
+        svg << "\t</g>\n</svg>";
+    }
+
+    ViewBox SMILAnimation::view_box() const {
+        /** The box around the kept keyframes, plus the pending ones that are
+         *  written at the end of each vertex's animation
+         */
+        ViewBox all = box;
+        for (auto& key : pending)
+            if (key.frame >= 0) all.add(key.x, key.y);
+
+        return all;
+    }
+
+    void SMILAnimation::positions(int frame, LayoutState& state) const {
+        /** Positions between two keyframes are interpolated linearly, as the
+         *  <animate> elements do, and vertices which never move stay put
+         */
+        if (state.size() != (int)keyframes.size())
+            throw std::runtime_error("State has " + std::to_string(state.size()) + " vertices, expected " +
+                std::to_string(keyframes.size()));
+
+        #pragma omp parallel for
+        for (int i = 0; i < state.size(); i++) {
+            const auto& kept = keyframes[i];
+            const bool extra = pending[i].frame >= 0 && kept.size() > 1;
+            const int count = (int)kept.size() + (extra ? 1 : 0);
+            auto key = [&](int k) -> const Keyframe& { return k < (int)kept.size() ? kept[k] : pending[i]; };
+
+            // Last keyframe at or before frame
+            int lo = 0, hi = count - 1;
+            while (lo < hi) {
+                const int mid = (lo + hi + 1) / 2;
+                if (key(mid).frame <= frame) lo = mid;
+                else hi = mid - 1;
+            }
+
+            const Keyframe& a = key(lo);
+            if (lo + 1 >= count || a.frame >= frame) {
+                state.x[i] = a.x;
+                state.y[i] = a.y;
+                continue;
+            }
+
+            const Keyframe& b = key(lo + 1);
+            const double t = (double)(frame - a.frame) / (b.frame - a.frame);
+            state.x[i] = a.x + t * (b.x - a.x);
+            state.y[i] = a.y + t * (b.y - a.y);
+        }
+    }
+
+    Raster rasterize(TUNGraph& graph, const LayoutState& state, const ViewBox& box, const int pixels) {
+        /** Render the drawing of graph at state, showing the region box
+         *  scaled to pixels wide. Lines are kept at least a pixel thick.
+         */
+        const double scale = pixels / (box.right() - box.left()), min_x = box.left(), min_y = box.top();
+        Raster image(pixels, std::max(1, (int)std::ceil((box.bottom() - box.top()) * scale)));
+
+        for (auto edge = graph.BegEI(); edge < graph.EndEI(); edge++) {
+            int u = state.index.at(edge.GetSrcNId()), v = state.index.at(edge.GetDstNId());
+            image.add_line((state.x[u] - min_x) * scale, (state.y[u] - min_y) * scale,
+                (state.x[v] - min_x) * scale, (state.y[v] - min_y) * scale, std::max(1.0, scale));
+        }
+
+        for (int i = 0; i < state.size(); i++)
+            image.add_circle((state.x[i] - min_x) * scale, (state.y[i] - min_y) * scale, box.radius * scale);
+
+        image.render();
+        return image;
+    }
+
+    Raster rasterize(TUNGraph& graph, const LayoutState& state, const int pixels, const double width) {
+        /** Render the drawing write_svg() makes, scaled to pixels wide */
+        return rasterize(graph, state, ViewBox(state, width), pixels);
+    }
+}
@@ -0,0 +1,293 @@
+#include "force_directed.h"
+#include <algorithm>
+#include <array>
+#include <numeric>
+#include <unordered_set>
+#include <errno.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace force_directed {
+    namespace {
+    struct SegmentHash {
+        size_t operator()(const std::array<long long, 4>& s) const {
+            size_t hash = 0;
+            for (long long value : s) hash = hash * 1000003 ^ std::hash<long long>()(value);
+            return hash;
+        }
+    };
+    }
+
+    TileIndex::TileIndex(TUNGraph& graph, const LayoutState& state, const TileParams& params) :
+        params(params), x(state.x), y(state.y) {
+        /** Index the drawing of graph at state. At each level, each edge long
+         *  enough to be drawn is listed in every tile its segment passes
+         *  through, so coarse tiles never read the same edge twice.
+         */
+        if (params.levels < 1 || params.levels > 12)
+            throw std::runtime_error("Tiles need between 1 and 12 zoom levels");
+        if (params.tile_size < 1) throw std::runtime_error("Tiles must be at least a pixel across");
+
+        const int n = state.size();
+        grid = 1 << (params.levels - 1);
+        min_x = min_y = 0;
+        side = 1;
+        if (n > 0) {
+            auto x_range = std::minmax_element(x.begin(), x.end()),
+                y_range = std::minmax_element(y.begin(), y.end());
+            min_x = *x_range.first;
+            min_y = *y_range.first;
+            side = std::max(*x_range.second - min_x, *y_range.second - min_y);
+            if (!(side > 0)) side = 1;
+        }
+
+        edges.reserve(graph.GetEdges());
+        for (auto edge = graph.BegEI(); edge < graph.EndEI(); edge++)
+            edges.push_back(std::make_pair(state.index.at(edge.GetSrcNId()), state.index.at(edge.GetDstNId())));
+
+        // Counting sort of vertices by cell
+        const int cells = grid * grid;
+        std::vector<int> cell_of(n);
+        #pragma omp parallel for
+        for (int i = 0; i < n; i++) {
+            const int cx = std::min(grid - 1, (int)((x[i] - min_x) / side * grid)),
+                cy = std::min(grid - 1, (int)((y[i] - min_y) / side * grid));
+            cell_of[i] = cy * grid + cx;
+        }
+
+        vertex_start.assign(cells + 1, 0);
+        for (int c : cell_of) vertex_start[c + 1]++;
+        std::partial_sum(vertex_start.begin(), vertex_start.end(), vertex_start.begin());
+
+        std::vector<int> next(vertex_start.begin(), vertex_start.end() - 1);
+        vertex_cells.resize(n);
+        for (int i = 0; i < n; i++) vertex_cells[next[cell_of[i]]++] = i;
+
+        // And for each level, of the edges drawn at it, once per tile crossed.
+        // Levels are independent, so they are indexed in parallel.
+        edge_start.resize(params.levels);
+        edge_tiles.resize(params.levels);
+
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (int level = 0; level < params.levels; level++) {
+            const int across = 1 << level;
+            auto& start = edge_start[level];
+            auto& listed = edge_tiles[level];
+
+            start.assign((size_t)across * across + 1, 0);
+            for (int e = 0; e < (int)edges.size(); e++)
+                if (drawn(e, level)) tiles_crossed(e, level, [&](long long t) { start[t + 1]++; });
+            std::partial_sum(start.begin(), start.end(), start.begin());
+
+            std::vector<long long> at(start.begin(), start.end() - 1);
+            listed.resize(start.back());
+            for (int e = 0; e < (int)edges.size(); e++)
+                if (drawn(e, level)) tiles_crossed(e, level, [&](long long t) { listed[at[t]++] = e; });
+        }
+    }
+
+    long long TileIndex::snap(double value, double origin, int level) const {
+        /** The pixel value falls in at a level, counting from origin. The far
+         *  edge of the drawing is in the last pixel.
+         */
+        const double pixel = side / ((double)params.tile_size * (1 << level));
+        const long long last_pixel = ((long long)params.tile_size << level) - 1;
+        return std::min(last_pixel, (long long)std::floor((value - origin) / pixel));
+    }
+
+    bool TileIndex::drawn(int e, int level) const {
+        /** Whether edge e is at least min_length pixels long between the pixels its ends fall in */
+        const int u = edges[e].first, v = edges[e].second;
+        return std::max(std::abs(snap(x[v], min_x, level) - snap(x[u], min_x, level)),
+            std::abs(snap(y[v], min_y, level) - snap(y[u], min_y, level))) >= params.min_length;
+    }
+
+    template<typename Visit>
+    void TileIndex::tiles_crossed(int e, int level, Visit visit) const {
+        /** Call visit() on each tile of a level the segment of edge e passes
+         *  through, a column of tiles at a time
+         */
+        const int across = 1 << level, u = edges[e].first, v = edges[e].second;
+        double x1 = (x[u] - min_x) / side * across, y1 = (y[u] - min_y) / side * across,
+            x2 = (x[v] - min_x) / side * across, y2 = (y[v] - min_y) / side * across;
+        if (x1 > x2) {
+            std::swap(x1, x2);
+            std::swap(y1, y2);
+        }
+
+        // A segment ending exactly on a tile boundary doesn't reach the next tile
+        auto clamp = [&](double t) { return std::max(0, std::min(across - 1, (int)std::floor(t))); };
+        auto last_of = [&](double lo, double hi) {
+            return hi > lo ? std::max(clamp(lo), clamp(std::ceil(hi) - 1)) : clamp(hi);
+        };
+
+        const int last_i = last_of(x1, x2);
+        for (int i = clamp(x1); i <= last_i; i++) {
+            double top = y1, bottom = y2;
+            if (x2 > x1) {
+                // Where the segment enters and leaves this column
+                const double slope = (y2 - y1) / (x2 - x1);
+                top = y1 + slope * (std::max(x1, (double)i) - x1);
+                bottom = y1 + slope * (std::min(x2, i + 1.0) - x1);
+            }
+
+            const int last = last_of(std::min(top, bottom), std::max(top, bottom));
+            for (int j = clamp(std::min(top, bottom)); j <= last; j++) visit((long long)j * across + i);
+        }
+    }
+
+    static void append_half(std::string& svg, long long value) {
+        // value + 0.5, the center of a pixel
+        if (value < 0) svg += '-' + std::to_string(-value - 1) + ".5";
+        else svg += std::to_string(value) + ".5";
+    }
+
+    std::string TileIndex::tile(int level, int tx, int ty) const {
+        /** Edges are drawn between the centers of the pixels their ends fall
+         *  in, and vertices at the center of theirs, with those landing on
+         *  the same pixels drawn once
+         */
+        if (level < 0 || level >= params.levels || tx < 0 || ty < 0 || tx >= (1 << level) || ty >= (1 << level))
+            throw std::runtime_error("No tile (" + std::to_string(tx) + ", " + std::to_string(ty) +
+                ") at level " + std::to_string(level));
+
+        const int size = params.tile_size, span = grid >> level; // Cells across a tile
+        const double pixel = side / ((double)size * (1 << level));
+        const long long ox = (long long)tx * size, oy = (long long)ty * size;
+        auto snap_x = [&](int v) { return snap(x[v], min_x, level); };
+        auto snap_y = [&](int v) { return snap(y[v], min_y, level); };
+
+        // Each edge crossing the tile is listed once. Those snapped to the
+        // same pixels are drawn once, in the order they were first listed.
+        std::vector<std::array<long long, 4>> segments;
+        std::unordered_set<std::array<long long, 4>, SegmentHash> seen_segments;
+        const long long t = (long long)ty * (1 << level) + tx;
+        for (long long k = edge_start[level][t]; k < edge_start[level][t + 1]; k++) {
+            const int u = edges[edge_tiles[level][k]].first, v = edges[edge_tiles[level][k]].second;
+            std::array<long long, 4> s = { { snap_x(u), snap_y(u), snap_x(v), snap_y(v) } };
+            if (std::make_pair(s[2], s[3]) < std::make_pair(s[0], s[1])) {
+                std::swap(s[0], s[2]);
+                std::swap(s[1], s[3]);
+            }
+
+            if (seen_segments.insert(s).second) segments.push_back(s);
+        }
+
+        // Vertices in neighboring cells may still have circles reaching into the tile
+        const int reach = (int)std::ceil(params.radius), width = size + 2 * reach,
+            margin = (int)std::ceil(params.radius * pixel * grid / side);
+        std::vector<bool> seen((size_t)width * width, false);
+        std::vector<std::pair<long long, long long>> points;
+
+        const int first_j = std::max(0, ty * span - margin), last_j = std::min(grid, (ty + 1) * span + margin),
+            first_i = std::max(0, tx * span - margin), last_i = std::min(grid, (tx + 1) * span + margin);
+        for (int j = first_j; j < last_j; j++) {
+            for (int i = first_i; i < last_i; i++) {
+                const int c = j * grid + i;
+                for (int k = vertex_start[c]; k < vertex_start[c + 1]; k++) {
+                    const long long px = snap_x(vertex_cells[k]) - ox, py = snap_y(vertex_cells[k]) - oy;
+                    if (px < -reach || py < -reach || px >= size + reach || py >= size + reach) continue;
+
+                    const size_t bit = (size_t)(py + reach) * width + (size_t)(px + reach);
+                    if (seen[bit]) continue;
+                    seen[bit] = true;
+                    points.push_back(std::make_pair(px, py));
+                }
+            }
+        }
+
+        if (segments.empty() && points.empty()) return "";
+
+        const std::string pixels = std::to_string(size);
+        std::string svg = "<svg height=\"" + pixels + "\" viewBox=\"0 0 " + pixels + " " + pixels +
+            "\" width=\"" + pixels + "\" xmlns=\"http://www.w3.org/2000/svg\">\n";
+
+        if (!segments.empty()) {
+            svg += "\t<g stroke=\"black\" stroke-width=\"1px\">\n";
+            for (auto& s : segments) {
+                svg += "\t\t<line x1=\"";
+                append_half(svg, s[0] - ox);
+                svg += "\" x2=\"";
+                append_half(svg, s[2] - ox);
+                svg += "\" y1=\"";
+                append_half(svg, s[1] - oy);
+                svg += "\" y2=\"";
+                append_half(svg, s[3] - oy);
+                svg += "\" />\n";
+            }
+            svg += "\t</g>\n";
+        }
+
+        if (!points.empty()) {
+            const std::string radius = std::to_string(params.radius);
+            svg += "\t<g>\n";
+            for (auto& p : points) {
+                svg += "\t\t<circle cx=\"";
+                append_half(svg, p.first);
+                svg += "\" cy=\"";
+                append_half(svg, p.second);
+                svg += "\" r=\"" + radius + "\" />\n";
+            }
+            svg += "\t</g>\n";
+        }
+
+        svg += "</svg>";
+        return svg;
+    }
+
+    static void make_directory(const std::string& path) {
+#ifdef _WIN32
+        if (_mkdir(path.c_str()) != 0 && errno != EEXIST)
+#else
+        if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST)
+#endif
+            throw std::runtime_error("Could not create directory " + path);
+    }
+
+    long long write_tiles(const std::string& directory, TUNGraph& graph, const LayoutState& state,
+        const TileParams& params) {
+        /** Cut the drawing of graph at state into tiles for every zoom level,
+         *  written to directory/level/x/y.svg as web maps lay them out. The
+         *  tiles are made in parallel. Blank tiles are not written, so
+         *  viewers should show nothing for a missing tile. Returns the
+         *  number of tiles written.
+         */
+        TileIndex index(graph, state, params);
+
+        std::vector<std::array<int, 3>> tiles;
+        make_directory(directory);
+        for (int level = 0; level < params.levels; level++) {
+            make_directory(directory + "/" + std::to_string(level));
+            for (int tx = 0; tx < (1 << level); tx++) {
+                make_directory(directory + "/" + std::to_string(level) + "/" + std::to_string(tx));
+                for (int ty = 0; ty < (1 << level); ty++) tiles.push_back({ { level, tx, ty } });
+            }
+        }
+
+        // Coarse tiles take longest, so they are handed out first
+        long long written = 0;
+        std::string failed;
+        #pragma omp parallel for schedule(dynamic, 1) reduction(+:written)
+        for (long long t = 0; t < (long long)tiles.size(); t++) {
+            const std::string svg = index.tile(tiles[t][0], tiles[t][1], tiles[t][2]);
+            if (svg.empty()) continue;
+
+            const std::string file = directory + "/" + std::to_string(tiles[t][0]) + "/" +
+                std::to_string(tiles[t][1]) + "/" + std::to_string(tiles[t][2]) + ".svg";
+            std::ofstream out(file);
+            out << svg;
+            if (out) written++;
+            else {
+                #pragma omp critical
+                failed = file;
+            }
+        }
+
+        if (!failed.empty()) throw std::runtime_error("Could not write " + failed);
+        return written;
+    }
+}
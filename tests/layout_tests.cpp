@@ -0,0 +1,827 @@
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+#include "force_directed.h"
+#undef Catch // SNAP's exception macro clashes with Catch's namespace
+
+using namespace force_directed;
+
+static int occurrences(const std::string& text, const std::string& pattern) {
+    // Number of (possibly overlapping) places pattern appears in text
+    int found = 0;
+    for (size_t at = text.find(pattern); at != std::string::npos; at = text.find(pattern, at + 1)) found++;
+    return found;
+}
+
+TEST_CASE("Barnes-Hut with theta = 0 is exact", "[barnes_hut_test]") {
+    TUNGraph graph = prism(50);
+    VertexPos pos = random_layout(graph);
+    LayoutState state(graph, pos);
+    CSRAdjacency adj(graph, state);
+    ForceDirectedParams params = { 400, 2, 1000 };
+    params.theta = 0;
+
+    QuadTree tree;
+    tree.build(state.x, state.y);
+
+    for (int node = 0; node < state.size(); node++) {
+        auto exact = eades84_helper::calculate_force(params, node, adj, state),
+            approx = eades84_helper::calculate_force(params, node, adj, state, tree);
+        REQUIRE(approx.first == Approx(exact.first));
+        REQUIRE(approx.second == Approx(exact.second));
+    }
+}
+
+TEST_CASE("Barnes-Hut approximates the electrical force", "[barnes_hut_test]") {
+    TUNGraph graph = prism(500);
+    VertexPos pos = random_layout(graph);
+    LayoutState state(graph, pos);
+    CSRAdjacency adj(graph, state);
+    ForceDirectedParams params = { 400, 0, 1000 }; // Electrical force only
+    params.theta = 0.5;
+
+    QuadTree tree;
+    tree.build(state.x, state.y);
+
+    // Compare the total error against the total force
+    double error = 0, total = 0;
+    for (int node = 0; node < state.size(); node++) {
+        auto exact = eades84_helper::calculate_force(params, node, adj, state),
+            approx = eades84_helper::calculate_force(params, node, adj, state, tree);
+        error += std::hypot(approx.first - exact.first, approx.second - exact.second);
+        total += std::hypot(exact.first, exact.second);
+    }
+
+    REQUIRE(error / total < 0.05);
+}
+
+TEST_CASE("Barnes-Hut never treats the cell around a body as one mass", "[barnes_hut_test]") {
+    // With theta = 1.5 the root passes the opening test from either body, but
+    // holds the body itself
+    std::vector<double> x = { 0, 100 }, y = { 0, 100 };
+    QuadTree tree;
+    tree.build(x, y);
+
+    for (int i = 0; i < 2; i++) {
+        auto force = tree.repulsion(i, x[i], y[i], 1000, 1.5);
+        double dx = x[i] - x[1 - i], dy = y[i] - y[1 - i], dist = std::hypot(dx, dy);
+        REQUIRE(force.first == Approx(1000 / (dist * dist) * dx / dist));
+        REQUIRE(force.second == Approx(1000 / (dist * dist) * dy / dist));
+    }
+}
+
+TEST_CASE("LayoutState round trip", "[layout_state_test]") {
+    TUNGraph graph = petersen();
+    VertexPos pos = random_layout(graph);
+    LayoutState state(graph, pos);
+
+    REQUIRE(state.size() == graph.GetNodes());
+    for (int i = 0; i < state.size(); i++) {
+        REQUIRE(state.index.at(state.ids[i]) == i);
+        REQUIRE(state.x[i] == pos[state.ids[i]].first);
+    }
+
+    REQUIRE(state.to_pos() == pos);
+}
+
+TEST_CASE("CSRAdjacency matches the graph", "[csr_test]") {
+    TUNGraph graph = generalized_petersen(7, 2);
+    LayoutState state(graph);
+    CSRAdjacency adj(graph, state);
+
+    REQUIRE(adj.size() == graph.GetNodes());
+    REQUIRE((int)adj.neighbors.size() == 2 * graph.GetEdges());
+    for (int u = 0; u < state.size(); u++) {
+        REQUIRE(adj.degree(u) == graph.GetNI(state.ids[u]).GetDeg());
+        REQUIRE(std::is_sorted(adj.begin(u), adj.end(u)));
+        for (auto v = adj.begin(u); v != adj.end(u); v++)
+            REQUIRE(graph.IsEdge(state.ids[u], state.ids[*v]));
+    }
+}
+
+TEST_CASE("SIMD repulsion matches the scalar path", "[simd_test]") {
+    TUNGraph graph = prism(1500);
+    VertexPos pos = random_layout(graph);
+    LayoutState state(graph, pos);
+    CSRAdjacency adj(graph, state);
+    ForceDirectedParams params = { 400, 0, 1000 }; // Electrical force only
+    const int n = state.size();
+
+    for (auto isa : { simd::Isa::SCALAR, simd::Isa::SSE2, simd::Isa::AVX2, simd::Isa::AVX512 }) {
+        if (isa > simd::detect()) continue;
+        simd::repulsion(isa, state.x.data(), state.y.data(), n, 0, n,
+            params.kuv2, state.fx.data(), state.fy.data());
+
+        for (int node = 0; node < n; node++) {
+            auto exact = eades84_helper::calculate_force(params, node, adj, state);
+
+            // Documented tolerance: 1e-12 of the sum of the term magnitudes
+            double magnitude = 0;
+            for (int v = 0; v < n; v++) {
+                if (v == node) continue;
+                magnitude += params.kuv2 / pow(eades84_helper::distance_between(state, node, v), 2);
+            }
+
+            REQUIRE(std::abs(state.fx[node] - exact.first) <= 1e-12 * magnitude);
+            REQUIRE(std::abs(state.fy[node] - exact.second) <= 1e-12 * magnitude);
+        }
+    }
+}
+
+TEST_CASE("Frame callbacks respect stride and final_only", "[frame_test]") {
+    TUNGraph graph = petersen();
+    VertexPos pos = random_layout(graph);
+    std::vector<int> iterations;
+    auto record = [&](const LayoutState&, int i) { iterations.push_back(i); };
+
+    FrameOptions options;
+    options.stride = 30;
+    eades84(graph, pos, record, options); // Runs for 100 iterations
+    REQUIRE(iterations == std::vector<int>({ 0, 30, 60, 90, 100 }));
+
+    iterations.clear();
+    options.final_only = true;
+    eades84(graph, pos, record, options);
+    REQUIRE(iterations == std::vector<int>({ 100 }));
+}
+
+TEST_CASE("Coarsening collapses a matching", "[multilevel_test]") {
+    TUNGraph graph = prism(100);
+    LayoutState state(graph);
+    CSRAdjacency fine(graph, state);
+    std::vector<int> parent;
+    std::mt19937 generator(0);
+    CSRAdjacency coarse = multilevel_helper::coarsen(fine, parent, generator);
+
+    // At most two fine vertices per coarse vertex
+    std::vector<int> count(coarse.size(), 0);
+    for (int c : parent) count[c]++;
+    for (int c : count) REQUIRE((c == 1 || c == 2));
+    REQUIRE(coarse.size() < fine.size());
+
+    // Every fine edge maps to a coarse edge or is collapsed
+    for (int u = 0; u < fine.size(); u++) {
+        for (auto v = fine.begin(u); v != fine.end(u); v++) {
+            if (parent[u] != parent[*v]) REQUIRE(coarse.adjacent(parent[u], parent[*v]));
+            else REQUIRE(fine.adjacent(u, *v));
+        }
+    }
+}
+
+TEST_CASE("Multilevel layout converges with and without coarsening", "[multilevel_test]") {
+    // prism(200) is coarsened, hypercube() is too small to be
+    for (TUNGraph graph : { prism(200), hypercube() }) {
+        // Start far from the natural length, which refinement alone can't fix in a few steps
+        VertexPos pos = random_layout(graph, 1);
+        ForceDirectedParams params = { 20, 2, 1 };
+
+        int iterations = 0;
+        eades84_multilevel(params, graph, pos, [&](const LayoutState&, int iteration) {
+            iterations = iteration;
+        });
+        REQUIRE(iterations < params.max_iterations);
+
+        // Edges settle at about the natural length
+        double total = 0;
+        for (auto edge = graph.BegEI(); edge < graph.EndEI(); edge++) {
+            auto u = pos[edge.GetSrcNId()], v = pos[edge.GetDstNId()];
+            double length = std::hypot(u.first - v.first, u.second - v.second);
+            REQUIRE(length == Approx(20).epsilon(0.5));
+            total += length;
+        }
+
+        REQUIRE(total / graph.GetEdges() == Approx(20).epsilon(0.1));
+    }
+}
+
+TEST_CASE("FMM error falls with the expansion order", "[fmm_test]") {
+    TUNGraph graph = prism(2000);
+    VertexPos pos = random_layout(graph);
+    LayoutState state(graph, pos);
+    const int n = state.size();
+
+    std::vector<double> exact_x(n), exact_y(n), fx, fy;
+    simd::repulsion(simd::Isa::SCALAR, state.x.data(), state.y.data(), n, 0, n,
+        1000, exact_x.data(), exact_y.data());
+
+    FastMultipole fmm;
+    double previous = 1;
+    for (int order : { 3, 5, 7 }) {
+        fmm.evaluate(state.x, state.y, 1000, order, fx, fy);
+
+        double error = 0, total = 0;
+        for (int i = 0; i < n; i++) {
+            error += std::hypot(fx[i] - exact_x[i], fy[i] - exact_y[i]);
+            total += std::hypot(exact_x[i], exact_y[i]);
+        }
+
+        REQUIRE(error / total < previous);
+        previous = error / total;
+    }
+
+    REQUIRE(previous < 1e-3);
+}
+
+TEST_CASE("Grid repulsion matches a brute force cutoff sum", "[grid_test]") {
+    TUNGraph graph = prism(500);
+    VertexPos pos = random_layout(graph);
+    LayoutState state(graph, pos);
+    const double cutoff = 50;
+
+    SpatialGrid grid;
+    grid.build(state.x, state.y, cutoff);
+
+    for (int i = 0; i < state.size(); i++) {
+        double sum_x = 0, sum_y = 0;
+        for (int j = 0; j < state.size(); j++) {
+            double dx = state.x[i] - state.x[j], dy = state.y[i] - state.y[j],
+                dist = std::hypot(dx, dy);
+            if (j == i || dist >= cutoff) continue;
+            sum_x += 1000 / (dist * dist) * dx / dist;
+            sum_y += 1000 / (dist * dist) * dy / dist;
+        }
+
+        auto approx = grid.repulsion(i, state.x[i], state.y[i], 1000);
+        REQUIRE(approx.first == Approx(sum_x));
+        REQUIRE(approx.second == Approx(sum_y));
+    }
+}
+
+TEST_CASE("eades84_2 stops once the layout is stable", "[integrator_test]") {
+    TUNGraph graph = hypercube();
+    VertexPos pos = random_layout(graph);
+    ForceDirectedParams params = { 400, 2, 1 };
+
+    int iterations = 0;
+    eades84_2(params, graph, pos, [&](const LayoutState&, int iteration) {
+        iterations = iteration;
+    });
+    REQUIRE(iterations < params.max_iterations);
+
+    for (auto edge = graph.BegEI(); edge < graph.EndEI(); edge++) {
+        auto u = pos[edge.GetSrcNId()], v = pos[edge.GetDstNId()];
+        REQUIRE(std::hypot(u.first - v.first, u.second - v.second) == Approx(400).epsilon(0.05));
+    }
+}
+
+TEST_CASE("Stress majorization is deterministic and lowers stress", "[stress_test]") {
+    TUNGraph graph = prism(200);
+    StressParams params;
+    params.hops = 2;
+    params.pivots = 10;
+
+    VertexPos first = random_layout(graph, 7), second = first;
+    LayoutState initial(graph, first);
+    CSRAdjacency adj(graph, initial);
+    auto terms = stress_helper::sparse_terms(params, adj);
+
+    // One term per pair of vertices, pivots included
+    std::set<std::pair<int, int>> pairs;
+    for (auto& t : terms) {
+        REQUIRE(t.i != t.j);
+        REQUIRE(pairs.insert(std::minmax(t.i, t.j)).second);
+    }
+
+    int iterations = 0;
+    stress_layout(params, graph, first, [&](const LayoutState&, int iteration) {
+        iterations = iteration;
+    });
+    stress_layout(params, graph, second);
+    REQUIRE(iterations < params.max_iterations);
+
+    LayoutState final_state(graph, first);
+    REQUIRE(stress_helper::stress(terms, final_state) < 0.05 * stress_helper::stress(terms, initial));
+
+    for (auto& p : first) {
+        REQUIRE(p.second.first == second[p.first].first);
+        REQUIRE(p.second.second == second[p.first].second);
+    }
+}
+
+TEST_CASE("Pivot MDS lays a cycle out on a circle", "[mds_test]") {
+    // With every vertex as a pivot this is classical MDS, which is exact here
+    TUNGraph graph = cycle(60);
+    VertexPos pos = pivot_mds_layout(graph, 100, 60);
+
+    double cx = 0, cy = 0;
+    for (auto& p : pos) {
+        cx += p.second.first / pos.size();
+        cy += p.second.second / pos.size();
+    }
+
+    // 60 edges of length 100 around a circle
+    const double radius = 100 / (2 * sin(M_PI / 60));
+    for (auto& p : pos)
+        REQUIRE(std::hypot(p.second.first - cx, p.second.second - cy) == Approx(radius));
+}
+
+TEST_CASE("Spectral refinement finds the smallest Laplacian eigenvectors", "[spectral_test]") {
+    // 30 x 20 grid: the two smallest nonzero eigenvalues are well separated
+    TUNGraph graph;
+    for (int i = 0; i < 600; i++) graph.AddNode(i);
+    for (int i = 0; i < 600; i++) {
+        if (i % 30 < 29) graph.AddEdge(i, i + 1);
+        if (i + 30 < 600) graph.AddEdge(i, i + 30);
+    }
+
+    LayoutState state(graph);
+    CSRAdjacency adj(graph, state);
+    auto laplacian = spectral_helper::laplacian(adj);
+
+    MatrixXd dense = MatrixXd(laplacian), d = MatrixXd(dense.diagonal().asDiagonal());
+    Eigen::GeneralizedSelfAdjointEigenSolver<MatrixXd> exact(dense, d);
+
+    std::mt19937 generator(0);
+    std::normal_distribution<double> normal;
+    spectral_helper::Block x(600, spectral_helper::BLOCK);
+    for (int v = 0; v < 600; v++)
+        for (int j = 0; j < spectral_helper::BLOCK; j++) x(v, j) = normal(generator);
+
+    spectral_helper::eigenvectors(laplacian, x, 1e-8, 100000, generator);
+    for (int j = 0; j < 2; j++) {
+        VectorXd v = x.col(j);
+        double rayleigh = v.dot(dense * v) / v.dot(d * v);
+        REQUIRE(rayleigh == Approx(exact.eigenvalues()(j + 1)).epsilon(1e-6));
+    }
+}
+
+TEST_CASE("Spectral layout separates the components of a disconnected graph", "[spectral_test]") {
+    // Two cycles, a path of two and an isolated vertex
+    TUNGraph graph = cycle(20);
+    for (int i = 0; i < 12; i++) graph.AddNode(100 + i);
+    for (int i = 0; i < 12; i++) graph.AddEdge(100 + i, 100 + (i + 1) % 12);
+    graph.AddNode(200);
+    graph.AddNode(201);
+    graph.AddEdge(200, 201);
+    graph.AddNode(300);
+
+    SpectralParams params;
+    VertexPos pos = spectral_layout(params, graph);
+    REQUIRE((int)pos.size() == graph.GetNodes());
+
+    for (auto& p : pos) {
+        REQUIRE(std::isfinite(p.second.first));
+        REQUIRE(std::isfinite(p.second.second));
+        for (auto& q : pos) {
+            if (q.first <= p.first) continue;
+            REQUIRE(std::hypot(p.second.first - q.second.first, p.second.second - q.second.second) > 1);
+        }
+    }
+
+    // Every edge keeps the length its component was laid out with
+    auto length = [&](int u, int v) {
+        return std::hypot(pos[u].first - pos[v].first, pos[u].second - pos[v].second);
+    };
+    REQUIRE(length(200, 201) == Approx(params.edge_length));
+    REQUIRE(length(100, 101) == Approx(length(105, 106)));
+
+    // ...so a spring layout can start from it
+    ForceDirectedParams spring = { 100, 2, 1 };
+    REQUIRE_NOTHROW(eades84_2(spring, graph, pos, [](const LayoutState&, int) {}));
+}
+
+TEST_CASE("Sparse barycenter solve puts free vertices at their barycenters", "[barycenter_test]") {
+    TUNGraph graph = generalized_petersen(30, 4);
+    auto output = barycenter_layout_la(graph, 30, 500);
+    REQUIRE(output.matrix.nonZeros() == 30 + 2 * 30); // Diagonal plus the inner cycle
+
+    VectorXd rx = output.matrix * output.sol_x - output.fixed_x,
+        ry = output.matrix * output.sol_y - output.fixed_y;
+    REQUIRE(rx.norm() < 1e-9);
+    REQUIRE(ry.norm() < 1e-9);
+}
+
+TEST_CASE("BarycenterSolver solves batches of boundaries", "[barycenter_test]") {
+    TUNGraph graph = generalized_petersen(12, 5);
+    BarycenterSolver solver(graph, 12);
+    REQUIRE(solver.fixed_count() == 12);
+    REQUIRE(solver.free_count() == 12);
+
+    // Column j is the polygon rotated by j degrees and scaled by 1 + j
+    const int k = 4;
+    MatrixXd fixed_x(12, k), fixed_y(12, k), free_x, free_y;
+    for (int j = 0; j < k; j++) {
+        auto polygon = SVG::util::polar_points(12, 0, 0, 100 * (1 + j));
+        for (int u = 0; u < 12; u++) {
+            double c = cos(j * M_PI / 180), s = sin(j * M_PI / 180);
+            fixed_x(u, j) = c * polygon[u].first - s * polygon[u].second;
+            fixed_y(u, j) = s * polygon[u].first + c * polygon[u].second;
+        }
+    }
+
+    solver.solve(fixed_x, fixed_y, free_x, free_y);
+    for (int j = 0; j < k; j++) {
+        std::vector<Point> boundary;
+        for (int u = 0; u < 12; u++) boundary.push_back(std::make_pair(fixed_x(u, j), fixed_y(u, j)));
+
+        VertexPos pos = solver.layout(boundary);
+        for (int i = 0; i < solver.free_count(); i++) {
+            auto p = pos[solver.id(12 + i)];
+            REQUIRE(free_x(i, j) == Approx(p.first));
+            REQUIRE(free_y(i, j) == Approx(p.second));
+        }
+    }
+
+    // The system is linear, so the solution scales with the boundary
+    REQUIRE(free_x.col(1).isApprox(2 * (cos(M_PI / 180) * free_x.col(0) - sin(M_PI / 180) * free_y.col(0)), 1e-9));
+}
+
+TEST_CASE("Iterative barycenter solvers match the direct solve", "[barycenter_test]") {
+    TUNGraph graph = generalized_petersen(40, 3);
+    auto exact = barycenter_layout_la(graph, 40, 500);
+
+    LayoutState state(graph);
+    CSRAdjacency adj(graph, state);
+    auto classes = barycenter_helper::color_classes(adj, 40);
+    for (auto& members : classes)
+        for (int u : members)
+            for (int v : members) REQUIRE(!adj.adjacent(u, v));
+
+    for (auto method : { Relaxation::JACOBI, Relaxation::SOR, Relaxation::MULTIGRID }) {
+        BarycenterParams params;
+        params.method = method;
+        params.tolerance = 1e-10;
+
+        LayoutState final_state;
+        FrameOptions options;
+        options.final_only = true;
+        barycenter_layout(graph, 40, 500, params, [&](const LayoutState& s, int) {
+            final_state = s;
+        }, options);
+
+        for (int i = 0; i < 40; i++) {
+            REQUIRE(final_state.x[40 + i] == Approx(exact.sol_x(i)).margin(1e-6));
+            REQUIRE(final_state.y[40 + i] == Approx(exact.sol_y(i)).margin(1e-6));
+        }
+    }
+}
+
+TEST_CASE("Barycenter layouts leave isolated free vertices at the origin", "[barycenter_test]") {
+    TUNGraph graph = prism(5);
+    graph.AddNode(100);
+    auto exact = barycenter_layout_la(graph, 5, 500);
+    REQUIRE(exact.pos[100] == std::make_pair(0.0, 0.0));
+
+    // Every free vertex reaches the direct solve, and Jacobi stops at its cap or sooner
+    auto frames = barycenter_layout(graph, 5, 500);
+    REQUIRE(!frames.empty());
+    REQUIRE(frames.size() <= 1001);
+
+    auto check = [&](const LayoutState& state, double margin) {
+        for (int u = 5; u < state.size(); u++) {
+            auto p = exact.pos[state.ids[u]];
+            REQUIRE(std::isfinite(state.x[u]));
+            REQUIRE(std::isfinite(state.y[u]));
+            REQUIRE(state.x[u] == Approx(p.first).margin(margin));
+            REQUIRE(state.y[u] == Approx(p.second).margin(margin));
+        }
+    };
+
+    LayoutState final_state;
+    int iterations = 0;
+    FrameOptions options;
+    options.final_only = true;
+    barycenter_layout(graph, 5, 500, [&](const LayoutState& s, int iteration) {
+        final_state = s;
+        iterations = iteration;
+    }, options);
+    REQUIRE(iterations < 1000);
+    check(final_state, 0.5);
+
+    for (auto method : { Relaxation::JACOBI, Relaxation::SOR, Relaxation::MULTIGRID }) {
+        BarycenterParams params;
+        params.method = method;
+        params.tolerance = 1e-10;
+        barycenter_layout(graph, 5, 500, params, [&](const LayoutState& s, int) {
+            final_state = s;
+        }, options);
+        check(final_state, 1e-6);
+    }
+}
+
+TEST_CASE("Incremental layout only moves the neighborhood of an edit", "[incremental_test]") {
+    TUNGraph graph = prism(50);
+    VertexPos pos = random_layout(graph, 3);
+    ForceDirectedParams params = { 400, 2, 1 };
+    params.repulsion = Repulsion::GRID;
+    eades84_2(params, graph, pos);
+
+    IncrementalLayout layout(params, graph, pos);
+    layout.add_edge(0, 1000);
+    layout.add_edge(1, 1000);
+
+    IncrementalParams options;
+    options.hops = 1;
+    const int relaxed = layout.update(options);
+    REQUIRE(relaxed < 10);
+
+    // Only 0, 1, 1000 and their neighbors were free to move
+    VertexPos after = layout.positions();
+    auto node = layout.graph().GetNI(1000);
+    std::set<int> near = { 0, 1, 1000 };
+    for (int id : { 0, 1 }) {
+        auto n = layout.graph().GetNI(id);
+        for (int k = 0; k < n.GetDeg(); k++) near.insert(n.GetNbrNId(k));
+    }
+
+    for (auto& p : pos) {
+        if (near.count(p.first)) continue;
+        REQUIRE(after[p.first] == p.second);
+    }
+
+    for (int k = 0; k < node.GetDeg(); k++) {
+        auto u = after[1000], v = after[node.GetNbrNId(k)];
+        REQUIRE(std::hypot(u.first - v.first, u.second - v.second) == Approx(400).epsilon(0.25));
+    }
+
+    // Removing vertices keeps the dense indices consistent
+    layout.remove_node(1000);
+    layout.remove_node(0);
+    layout.update(options);
+    const LayoutState& state = layout.state();
+    REQUIRE(state.size() == layout.graph().GetNodes());
+    for (int u = 0; u < state.size(); u++) REQUIRE(state.index.at(state.ids[u]) == u);
+}
+
+TEST_CASE("Binary edge lists round trip", "[edge_list_test]") {
+    TUNGraph expected = generalized_petersen(20, 3);
+    for (int width : { 4, 8 }) {
+        const std::string file = "edge_list_test.bin";
+        {
+            EdgeListWriter writer(file, width);
+            for (auto edge = expected.BegEI(); edge < expected.EndEI(); edge++) {
+                writer.add(edge.GetDstNId(), edge.GetSrcNId());
+                writer.add(edge.GetSrcNId(), edge.GetDstNId()); // Repeats are dropped
+            }
+
+            writer.close();
+        }
+
+        REQUIRE(is_edge_list(file));
+        TUNGraph graph;
+        read_edge_list(file, graph);
+        std::remove(file.c_str());
+
+        REQUIRE(graph.GetNodes() == expected.GetNodes());
+        REQUIRE(graph.GetEdges() == expected.GetEdges());
+        for (auto node = expected.BegNI(); node < expected.EndNI(); node++) {
+            auto copy = graph.GetNI(node.GetId());
+            REQUIRE(copy.GetDeg() == node.GetDeg());
+            for (int k = 0; k < node.GetDeg(); k++) REQUIRE(copy.GetNbrNId(k) == node.GetNbrNId(k));
+        }
+    }
+
+    // A writer that is never closed, here because an id is too wide, leaves no edge list
+    const std::string file = "edge_list_test.bin";
+    try {
+        EdgeListWriter writer(file, 4);
+        writer.add(0, 1);
+        writer.add(0, 1LL << 40);
+    }
+    catch (std::runtime_error&) {}
+
+    REQUIRE(!is_edge_list(file));
+    TUNGraph graph;
+    REQUIRE_THROWS(read_edge_list(file, graph));
+    std::remove(file.c_str());
+}
+
+TEST_CASE("Chunked CSV reader matches the graph it was written from", "[csv_test]") {
+    // Large enough to be split into several chunks
+    TUNGraph expected = prism(100000);
+    const std::string file = "csv_test.csv";
+    {
+        std::ofstream out(file);
+        out << "source,target\r\n";
+        for (auto edge = expected.BegEI(); edge < expected.EndEI(); edge++)
+            out << edge.GetSrcNId() << ", \"" << edge.GetDstNId() << "\"\r\n";
+        out << "\n";
+    }
+
+    TUNGraph graph;
+    read_edge_csv(file, graph);
+    REQUIRE(graph.GetNodes() == expected.GetNodes());
+    REQUIRE(graph.GetEdges() == expected.GetEdges());
+    int found = 0;
+    for (auto edge = expected.BegEI(); edge < expected.EndEI(); edge++)
+        found += graph.IsEdge(edge.GetSrcNId(), edge.GetDstNId());
+    REQUIRE(found == expected.GetEdges());
+
+    // The chunked reader passes the edges on in file order
+    std::vector<long long> endpoints;
+    read_edge_csv(file, [&](const std::vector<long long>& chunk) {
+        endpoints.insert(endpoints.end(), chunk.begin(), chunk.end());
+    });
+    REQUIRE((int)endpoints.size() == 2 * expected.GetEdges());
+    size_t at = 0;
+    for (auto edge = expected.BegEI(); edge < expected.EndEI(); edge++, at += 2) {
+        REQUIRE(endpoints[at] == edge.GetSrcNId());
+        REQUIRE(endpoints[at + 1] == edge.GetDstNId());
+    }
+
+    {
+        std::ofstream out(file);
+        out << "0,1.5,-2\n1,2.5e3,.125\n0,-0.0625,1E-2\n";
+    }
+
+    VertexPos pos;
+    read_positions_csv(file, pos);
+    std::remove(file.c_str());
+    REQUIRE(pos.size() == 2);
+    REQUIRE(pos[0] == std::make_pair(-0.0625, 0.01));
+    REQUIRE(pos[1] == std::make_pair(2500.0, 0.125));
+
+    // Positions take the same vertex ids as edges
+    {
+        std::ofstream out(file);
+        out << "0,1,2\n-3,4,5\n";
+    }
+
+    REQUIRE_THROWS(read_positions_csv(file, pos));
+    std::remove(file.c_str());
+
+    double value;
+    for (std::string number : { "3.14159265358979", "-1e-300", "123456789012345678901234", "0.000001" }) {
+        REQUIRE(csv_helper::parse_double(number.data(), number.data() + number.size(), value));
+        REQUIRE(value == Approx(strtod(number.c_str(), nullptr)).epsilon(1e-15));
+    }
+
+    for (std::string bad : { "", "-", "1.2.3", "1e", "x" })
+        REQUIRE(!csv_helper::parse_double(bad.data(), bad.data() + bad.size(), value));
+}
+
+TEST_CASE("Layout snapshots round trip", "[snapshot_test]") {
+    TUNGraph graph = prism(30), reordered;
+    for (int u = 59; u >= 0; u--) reordered.AddNode(u);
+    for (auto edge = graph.BegEI(); edge < graph.EndEI(); edge++)
+        reordered.AddEdge(edge.GetDstNId(), edge.GetSrcNId());
+    REQUIRE(graph_hash(graph) == graph_hash(reordered));
+
+    VertexPos pos = random_layout(graph, 5);
+    LayoutState state(graph, pos);
+    const std::string file = "snapshot_test.bin";
+
+    for (int width : { 8, 4 }) {
+        write_snapshot(file, graph, state, 42, width);
+        REQUIRE(is_snapshot(file));
+
+        VertexPos copy;
+        auto header = read_snapshot(file, copy);
+        REQUIRE(header.iteration == 42);
+        REQUIRE(header.graph_hash == graph_hash(graph));
+        REQUIRE(copy.size() == pos.size());
+        for (auto& p : pos) {
+            REQUIRE(copy[p.first].first == (width == 8 ? p.second.first : (float)p.second.first));
+            REQUIRE(copy[p.first].second == (width == 8 ? p.second.second : (float)p.second.second));
+        }
+    }
+
+    std::remove(file.c_str());
+    graph.AddEdge(0, 2);
+    REQUIRE(graph_hash(graph) != graph_hash(reordered));
+}
+
+TEST_CASE("Streaming SVG writer formats coordinates like the SVG library", "[svg_test]") {
+    TUNGraph graph = prism(20);
+    VertexPos pos = random_layout(graph, 11);
+    pos[0] = std::make_pair(-0.0000001, 1e15);
+    pos[1] = std::make_pair(-123.4567895, 0.0);
+    LayoutState state(graph, pos);
+
+    std::stringstream out;
+    write_svg(out, graph, state);
+    const std::string svg = out.str();
+
+    REQUIRE(occurrences(svg, "<line ") == graph.GetEdges());
+    REQUIRE(occurrences(svg, "<circle ") == graph.GetNodes());
+    for (int i = 0; i < state.size(); i++) {
+        REQUIRE(occurrences(svg, "cx=\"" + std::to_string(state.x[i]) + "\"") == 1);
+        REQUIRE(occurrences(svg, "cy=\"" + std::to_string(state.y[i]) + "\"") == 1);
+    }
+}
+
+TEST_CASE("SMIL animation writes each element once", "[svg_test]") {
+    TUNGraph graph = prism(5);
+    SMILAnimation animation(graph);
+
+    // Vertex 0 moves every frame, vertex 1 only in the middle frames and
+    // the rest jitter by less than the tolerance
+    VertexPos pos = random_layout(graph, 3);
+    LayoutState state(graph, pos);
+    std::vector<LayoutState> added;
+    for (int frame = 0; frame < 10; frame++) {
+        state.x[0] += 10;
+        if (frame >= 4 && frame < 6) state.y[1] += 10;
+        for (int i = 2; i < state.size(); i++) state.x[i] += (frame % 2 ? 0.01 : -0.01);
+        animation.add_frame(state);
+        added.push_back(state);
+    }
+
+    // Every frame can be recovered to within the tolerance, inside the view box
+    const ViewBox box = animation.view_box();
+    LayoutState shown(graph);
+    for (int frame = 0; frame < 10; frame++) {
+        animation.positions(frame, shown);
+        for (int i = 0; i < shown.size(); i++) {
+            REQUIRE(shown.x[i] == Approx(added[frame].x[i]).margin(0.1));
+            REQUIRE(shown.y[i] == Approx(added[frame].y[i]).margin(0.1));
+            REQUIRE(shown.x[i] - box.radius >= box.left() + ViewBox::MARGIN);
+            REQUIRE(shown.x[i] + box.radius <= box.right() - ViewBox::MARGIN);
+            REQUIRE(shown.y[i] - box.radius >= box.top() + ViewBox::MARGIN);
+            REQUIRE(shown.y[i] + box.radius <= box.bottom() - ViewBox::MARGIN);
+        }
+    }
+
+    std::stringstream out;
+    animation.write(out, 5);
+    const std::string svg = out.str();
+
+    REQUIRE(animation.frames() == 10);
+    REQUIRE(occurrences(svg, "<line ") == graph.GetEdges());
+    REQUIRE(occurrences(svg, "<circle ") == graph.GetNodes());
+
+    // Each circle has two <animate>s if it moves, and each line two per end that moves
+    REQUIRE(occurrences(svg, "attributeName=\"cx\"") == 2);
+    REQUIRE(occurrences(svg, "attributeName=\"x1\"") + occurrences(svg, "attributeName=\"x2\"") == 6);
+
+    // Every frame of vertex 0, but vertex 1 keeps only the ends of its still runs
+    // (frames 0, 3, 4, 5, 9) plus the repeated last frame
+    REQUIRE(occurrences(svg, "keyTimes=\"0.000000;0.100000;0.200000;0.300000;0.400000;0.500000;"
+        "0.600000;0.700000;0.800000;0.900000;1\"") == 2 * (1 + 3));
+    REQUIRE(occurrences(svg, "keyTimes=\"0.000000;0.300000;0.400000;0.500000;0.900000;1\"") == 2 * (1 + 3));
+
+    // A last frame within the tolerance of the one before is still in the view box
+    SMILAnimation still(graph);
+    still.add_frame(state);
+    for (int i = 0; i < state.size(); i++) state.x[i] += 0.05;
+    still.add_frame(state);
+
+    const double right = *std::max_element(state.x.begin(), state.x.end());
+    REQUIRE(still.view_box().right() == Approx(right + still.view_box().radius + ViewBox::MARGIN));
+}
+
+TEST_CASE("Tiles merge features smaller than a pixel", "[tile_test]") {
+    // A tight cluster of ten vertices and one far away vertex
+    TUNGraph graph;
+    VertexPos pos;
+    for (int i = 0; i <= 10; i++) {
+        graph.AddNode(i);
+        pos[i] = std::make_pair(i < 10 ? 1e-4 * i : 1000, i < 10 ? 1e-4 * (i % 3) : 1000);
+    }
+    for (int i = 0; i < 10; i++) graph.AddEdge(i, (i + 1) % 10);
+    graph.AddEdge(0, 10);
+
+    TileParams params;
+    params.levels = 3;
+    params.radius = 0;
+    TileIndex index(graph, LayoutState(graph, pos), params);
+
+    for (int level = 0; level < params.levels; level++) {
+        int circles = 0, lines = 0;
+        for (int tx = 0; tx < (1 << level); tx++) {
+            for (int ty = 0; ty < (1 << level); ty++) {
+                const std::string svg = index.tile(level, tx, ty);
+                circles += occurrences(svg, "<circle ");
+                lines += occurrences(svg, "<line ");
+
+                // Only tiles on the diagonal are crossed by the long edge
+                REQUIRE(svg.empty() == (tx != ty));
+            }
+        }
+
+        REQUIRE(circles == 2);
+        REQUIRE(lines == (1 << level));
+    }
+
+    REQUIRE_THROWS(index.tile(params.levels, 0, 0));
+}
+
+TEST_CASE("Rasterizer does not depend on the number of threads", "[raster_test]") {
+    auto draw = [](int threads) {
+        set_threads(threads);
+        Raster image(300, 200);
+        for (int i = 0; i < 100; i++)
+            image.add_line(150, 100, 150 + 140 * cos(i * 0.3), 100 + 90 * sin(i * 0.3), 1 + i % 3);
+        image.add_circle(20.5, 20.5, 5);
+        image.render();
+        return image;
+    };
+
+    Raster serial = draw(1), parallel = draw(4);
+    set_threads(0);
+    for (int y = 0; y < 200; y++)
+        for (int x = 0; x < 300; x++) REQUIRE(serial.at(x, y) == parallel.at(x, y));
+
+    // Inside the circle, on its rim, and clear of everything
+    REQUIRE(serial.at(20, 20) == 0);
+    REQUIRE(serial.at(25, 20) > 0);
+    REQUIRE(serial.at(25, 20) < 255);
+    REQUIRE(serial.at(5, 195) == 255);
+
+    std::stringstream png;
+    serial.write_png(png);
+    REQUIRE(png.str().substr(0, 8) == "\x89PNG\r\n\x1a\n");
+
+    std::stringstream ppm;
+    serial.write_ppm(ppm);
+    REQUIRE(ppm.str().size() == std::string("P6\n300 200\n255\n").size() + 300 * 200 * 3);
+}